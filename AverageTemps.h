@@ -1,37 +1,131 @@
-#include "Sensor.h"
-#include <algorithm>
+#ifndef AVERAGE_TEMPS_H_
+#define AVERAGE_TEMPS_H_
 
-template<typename InputIt, typename MemberType>
-float averageGreaterThanZero(InputIt&& begin, InputIt&& end, MemberType Sensor::*var) {
-  using value_type = typename std::iterator_traits<InputIt>::value_type;
+#include "FixedTemp.h"
+#include <stddef.h>
+#include <stdint.h>
 
-  unsigned int count = 0;
-  float total = 0;
+// Partial results kept side by side by statsOf(), one per lane, so the
+// compiler can vectorise across them
+#ifndef STATS_LANES
+#define STATS_LANES 8
+#endif
 
-  for_each(std::forward<InputIt>(begin), std::forward<InputIt>(end), [var, &count, &total](const value_type& x) {
-    if(x.*var > 0) {
-      total += x.*var;
-      ++count;
-    }
-  });
+// Integer square root, rounded down
+inline uint32_t isqrt64(uint64_t n) {
+  uint64_t root = 0;
+  uint64_t bit = 1ULL << 62;
 
-  return count == 0 ? 0 : total / count;
+  while (bit > n) bit >>= 2;
+  while (bit != 0) {
+    if (n >= root + bit) {
+      n -= root + bit;
+      root = (root >> 1) + bit;
+    } else {
+      root >>= 1;
+    }
+    bit >>= 2;
+  }
+  return static_cast<uint32_t>(root);
 }
 
-template<typename InputIt>
-float averageGreaterThanZero(InputIt&& begin, InputIt&& end) {
-  using value_type = typename std::iterator_traits<InputIt>::value_type;
+// Count, mean, min, max and variance of the valid readings, built in one
+// pass a sample at a time or merged from partial results. The sums are
+// exact in fixed point, so plain moments lose nothing and need none of the
+// divides Welford's update does.
+struct Stats {
+  int32_t count = 0;
+  int32_t sum = 0;
+  int64_t sumSquares = 0;
+  RawTemp min = INT16_MAX;
+  RawTemp max = INT16_MIN;
+
+  // An invalid reading is masked out rather than branched around. It's the
+  // lowest value there is, so it can't win max, and reads as INT16_MAX for
+  // min.
+  void add(RawTemp x) {
+    int32_t mask = -static_cast<int32_t>(x != RAW_TEMP_INVALID);
+    int32_t sample = x & mask;
+
+    count -= mask;
+    sum += sample;
+    sumSquares += sample * sample;
+    min = (sample | (~mask & INT16_MAX)) < min ? x : min;
+    max = x > max ? x : max;
+  }
+
+  void merge(const Stats &other) {
+    count += other.count;
+    sum += other.sum;
+    sumSquares += other.sumSquares;
+    min = other.min < min ? other.min : min;
+    max = other.max > max ? other.max : max;
+  }
+
+  RawTemp mean() const {
+    return count == 0 ? RAW_TEMP_INVALID : divRound(sum, count);
+  }
+
+  RawTemp minimum() const {
+    return count == 0 ? RAW_TEMP_INVALID : min;
+  }
+
+  RawTemp maximum() const {
+    return count == 0 ? RAW_TEMP_INVALID : max;
+  }
 
-  unsigned int count = 0;
-  float total = 0;
+  // Sample standard deviation in 1/16ths of a RawTemp step (1/256 C)
+  uint32_t stddev16() const {
+    int64_t spread;
 
-  for_each(std::forward<InputIt>(begin), std::forward<InputIt>(end), [&count, &total](const value_type& x) {
-    if(x > 0) {
-      total += x;
-      ++count;
+    if (count < 2) return 0;
+
+    spread = count * sumSquares - static_cast<int64_t>(sum) * sum;
+    return isqrt64(static_cast<uint64_t>(spread) * 256 / (static_cast<int64_t>(count) * (count - 1)));
+  }
+};
+
+// Stats over contiguous readings. Each of the STATS_LANES lanes takes every
+// STATS_LANES-th reading, then the lanes are merged.
+inline Stats statsOf(const RawTemp *data, size_t n) {
+  int32_t count[STATS_LANES] = {}, sum[STATS_LANES] = {};
+  int64_t sumSquares[STATS_LANES] = {};
+  RawTemp min[STATS_LANES], max[STATS_LANES];
+  Stats stats;
+  size_t i = 0;
+
+  for (uint8_t lane = 0; lane < STATS_LANES; lane++) {
+    min[lane] = INT16_MAX;
+    max[lane] = INT16_MIN;
+  }
+
+  for (; i + STATS_LANES <= n; i += STATS_LANES) {
+    for (uint8_t lane = 0; lane < STATS_LANES; lane++) {
+      RawTemp x = data[i + lane];
+      int32_t mask = -static_cast<int32_t>(x != RAW_TEMP_INVALID);
+      int32_t sample = x & mask;
+
+      count[lane] -= mask;
+      sum[lane] += sample;
+      sumSquares[lane] += sample * sample;
+      min[lane] = (sample | (~mask & INT16_MAX)) < min[lane] ? x : min[lane];
+      max[lane] = x > max[lane] ? x : max[lane];
     }
-  });
+  }
+
+  for (uint8_t lane = 0; lane < STATS_LANES; lane++) {
+    Stats partial;
+
+    partial.count = count[lane];
+    partial.sum = sum[lane];
+    partial.sumSquares = sumSquares[lane];
+    partial.min = min[lane];
+    partial.max = max[lane];
+    stats.merge(partial);
+  }
+  for (; i < n; i++) stats.add(data[i]);
 
-  return count == 0 ? 0 : total / count;
+  return stats;
 }
 
+#endif // AVERAGE_TEMPS_H_
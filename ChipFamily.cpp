@@ -0,0 +1,16 @@
+#include "ChipFamily.h"
+
+static constexpr ChipFamily CHIP_FAMILIES[] = {
+  chipFamily<DS18S20Family>(0x10, "DS18S20", false, true),
+  chipFamily<ConfigurableResolutionFamily>(0x22, "DS1822", true, true),
+  chipFamily<DS2438Family>(0x26, "DS2438", false, false),
+  chipFamily<ConfigurableResolutionFamily>(0x28, "DS18B20", true, true),
+  chipFamily<ConfigurableResolutionFamily>(0x42, "DS28EA00", true, true)
+};
+
+const ChipFamily *findChipFamily(byte code) {
+  for (const ChipFamily &family : CHIP_FAMILIES) {
+    if (family.code == code) return &family;
+  }
+  return NULL;
+}
@@ -0,0 +1,212 @@
+#ifndef CHIP_FAMILY_H_
+#define CHIP_FAMILY_H_
+
+#include "OneWire.h"
+#include "FixedTemp.h"
+
+#define SCRATCHPAD_SIZE 9 // the longest scratchpad, CRC included
+#define SCRATCHPAD_COMMAND_SIZE 2 // the longest read command, page number included
+
+// Worst case conversion times from the datasheets, in milliseconds
+#define CONVERSION_TIME_9_BIT 94
+#define CONVERSION_TIME_10_BIT 188
+#define CONVERSION_TIME_11_BIT 375
+#define CONVERSION_TIME_12_BIT 750
+#define CONVERSION_TIME_DS2438 10
+
+// A scratchpad as it came off the wire, and what it decoded to
+struct Scratchpad {
+  byte data[SCRATCHPAD_SIZE];
+  RawTemp raw;
+  byte resolution;
+};
+
+// Sends the read command and reads the scratchpad of a sensor that's
+// already been selected, and recalled if its family needs it. False if the CRC or the family's own sanity
+// check fails, in which case only `data` is filled in.
+typedef bool (*ScratchpadReader)(OneWire &ds, Scratchpad &scratchpad);
+// The same read in two halves, for buses that queue their traffic: the
+// bytes of the read command, returning how many, and the checks and
+// decoding of a scratchpad already in `data`. The same signature gives
+// the command, if any, that has to run in a transaction of its own
+// before the scratchpad holds the reading.
+typedef byte (*ScratchpadCommand)(byte command[SCRATCHPAD_COMMAND_SIZE]);
+typedef bool (*ScratchpadDecoder)(Scratchpad &scratchpad);
+typedef uint16_t (*ConversionTime)(byte resolution);
+
+// Everything that differs between the sensor families, looked up once by
+// ROM family code when a sensor is found.
+struct ChipFamily {
+  byte code;
+  const char *name;
+  byte scratchpadLength;
+  bool configurable; // resolution can be set, and Write Scratchpad takes a config byte
+  bool alarm; // has TH/TL and answers Alarm Search
+  ScratchpadReader read;
+  ScratchpadCommand recall; // 0 bytes when the scratchpad is always current
+  ScratchpadCommand command;
+  ScratchpadDecoder decode;
+  ConversionTime conversionTime;
+};
+
+// Null for families that aren't temperature sensors
+const ChipFamily *findChipFamily(byte code);
+
+//
+// Family policies. Each one describes its scratchpad layout; readAs<> and
+// decodeAs<> put them together into the functions the table points at,
+// so decoding is straight line code with no type switches.
+//
+
+// DS18B20, DS1822 and DS28EA00: 1/16 C two's complement with the
+// resolution in the config register
+struct ConfigurableResolutionFamily {
+  static const byte LENGTH = 9;
+
+  static byte recall(byte[]) {
+    return 0;
+  }
+
+  static byte command(byte out[]) {
+    out[0] = 0xBE; // Read Scratchpad
+    return 1;
+  }
+
+  // Bit 7 and the low five bits of the config register always read back
+  // 0 and 1. Clones differ in the reserved bytes, so they aren't checked.
+  static bool valid(const byte data[]) {
+    return (data[4] & 0x9F) == 0x1F;
+  }
+
+  static byte resolution(const byte data[]) {
+    return 9 + ((data[4] >> 5) & 3);
+  }
+
+  static RawTemp decode(const byte data[]) {
+    RawTemp raw = static_cast<int16_t>((data[1] << 8) | data[0]);
+
+    // at lower resolutions the low bits are undefined, so zero them
+    return raw & ~((1 << (12 - resolution(data))) - 1);
+  }
+
+  static uint16_t conversionTime(byte resolution) {
+    switch (resolution) {
+    case 9: return CONVERSION_TIME_9_BIT;
+    case 10: return CONVERSION_TIME_10_BIT;
+    case 11: return CONVERSION_TIME_11_BIT;
+    default: return CONVERSION_TIME_12_BIT;
+    }
+  }
+};
+
+// DS18S20: 1/2 C steps, with COUNT_REMAIN giving 1/16 C
+struct DS18S20Family {
+  static const byte LENGTH = 9;
+
+  static byte recall(byte[]) {
+    return 0;
+  }
+
+  static byte command(byte out[]) {
+    out[0] = 0xBE; // Read Scratchpad
+    return 1;
+  }
+
+  // Bytes 4 and 5 are reserved as 0xFF, COUNT_PER_C is hardwired to 16
+  static bool valid(const byte data[]) {
+    return data[4] == 0xFF && data[5] == 0xFF && data[7] == 0x10;
+  }
+
+  static byte resolution(const byte[]) {
+    return 12; // with COUNT_REMAIN
+  }
+
+  static RawTemp decode(const byte data[]) {
+    RawTemp half = static_cast<int16_t>((data[1] << 8) | data[0]);
+
+    // truncate the half degree bit, then add back 1/16 steps
+    return (half & ~1) * 8 + 12 - data[6];
+  }
+
+  static uint16_t conversionTime(byte) {
+    return CONVERSION_TIME_12_BIT;
+  }
+};
+
+// DS2438 page 0: 1/32 C in the top 13 bits of bytes 1 and 2. Conversions
+// land in the page's SRAM, the scratchpad only gets them on Recall Memory.
+struct DS2438Family {
+  static const byte LENGTH = 9;
+
+  static byte recall(byte out[]) {
+    out[0] = 0xB8; // Recall Memory
+    out[1] = 0x00; // page 0
+    return 2;
+  }
+
+  static byte command(byte out[]) {
+    out[0] = 0xBE; // Read Scratchpad
+    out[1] = 0x00; // page 0
+    return 2;
+  }
+
+  // The three low bits of the temperature LSB are always zero
+  static bool valid(const byte data[]) {
+    return (data[1] & 0x07) == 0;
+  }
+
+  static byte resolution(const byte[]) {
+    return 12;
+  }
+
+  // An arithmetic shift, as GCC does on every target we build for
+  static RawTemp decode(const byte data[]) {
+    return static_cast<int16_t>((data[2] << 8) | data[1]) >> 4;
+  }
+
+  static uint16_t conversionTime(byte) {
+    return CONVERSION_TIME_DS2438;
+  }
+};
+
+// An all zero frame, a bus shorted low, passes the CRC
+inline bool allZero(const byte data[], byte length) {
+  byte bits = 0;
+
+  for (byte i = 0; i < length; i++) bits |= data[i];
+  return bits == 0;
+}
+
+template<class Family>
+bool decodeAs(Scratchpad &scratchpad) {
+  byte *data = scratchpad.data;
+
+  if (OneWire::crc8(data, Family::LENGTH - 1) != data[Family::LENGTH - 1] ||
+      allZero(data, Family::LENGTH) || !Family::valid(data)) {
+    return false;
+  }
+
+  scratchpad.resolution = Family::resolution(data);
+  scratchpad.raw = Family::decode(data);
+  return true;
+}
+
+template<class Family>
+bool readAs(OneWire &ds, Scratchpad &scratchpad) {
+  byte command[SCRATCHPAD_COMMAND_SIZE];
+  byte length = Family::command(command);
+
+  for (byte i = 0; i < length; i++) ds.write(command[i]);
+  ds.read_bytes(scratchpad.data, Family::LENGTH);
+
+  return decodeAs<Family>(scratchpad);
+}
+
+template<class Family>
+constexpr ChipFamily chipFamily(byte code, const char *name, bool configurable, bool alarm) {
+  static_assert(Family::LENGTH <= SCRATCHPAD_SIZE, "Scratchpad longer than SCRATCHPAD_SIZE");
+
+  return ChipFamily{ code, name, Family::LENGTH, configurable, alarm, &readAs<Family>, &Family::recall, &Family::command, &decodeAs<Family>, &Family::conversionTime };
+}
+
+#endif // CHIP_FAMILY_H_
@@ -0,0 +1,65 @@
+#ifndef FIXED_TEMP_H_
+#define FIXED_TEMP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Temperatures go from the scratchpad to /metrics in the sensors' own fixed
+// point, 1/16 degree C in an int16_t. The Photon's Cortex-M3 has no FPU, so
+// this keeps every step in integer instructions.
+typedef int16_t RawTemp;
+
+#define RAW_TEMP_INVALID INT16_MIN // no reading
+
+// Readings outside -30F..120F (exclusive) are rejected as garbage
+#define RAW_TEMP_MIN -551
+#define RAW_TEMP_MAX 782
+
+// Degrees F scaled by FAHRENHEIT_SCALE. A 1/16 C step is exactly 0.1125F,
+// so four decimal places hold any RawTemp with no rounding.
+#define FAHRENHEIT_SCALE 10000L
+
+inline int32_t rawToFahrenheit(RawTemp raw) {
+  return raw * 1125L + 32 * FAHRENHEIT_SCALE;
+}
+
+// A temperature difference, e.g. a standard deviation, which has no offset
+inline int32_t rawDeltaToFahrenheit(int32_t raw) {
+  return raw * 1125L;
+}
+
+// Rounds half away from zero, like lround()
+inline int32_t divRound(int32_t n, int32_t d) {
+  return (n < 0) == (d < 0) ? (n + d / 2) / d : (n - d / 2) / d;
+}
+
+// Writes value / 10^decimals in decimal without touching floating point,
+// e.g. formatFixed(buf, 20, -123456, 4) gives "-12.3456". Returns the
+// length, truncating to fit like snprintf().
+inline size_t formatFixed(char *buf, size_t size, int32_t value, uint8_t decimals) {
+  char digits[12];
+  uint32_t magnitude = value < 0 ? -static_cast<uint32_t>(value) : value;
+  uint8_t count = 0;
+  size_t length = 0;
+
+  if (size == 0) return 0;
+
+  do {
+    digits[count++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude > 0 || count <= decimals);
+
+  if (value < 0 && length + 1 < size) buf[length++] = '-';
+  while (count > 0 && length + 1 < size) {
+    if (count == decimals) {
+      buf[length++] = '.';
+      if (length + 1 >= size) break;
+    }
+    buf[length++] = digits[--count];
+  }
+  buf[length] = '\0';
+
+  return length;
+}
+
+#endif // FIXED_TEMP_H_
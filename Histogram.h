@@ -0,0 +1,51 @@
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include "application.h"
+#include <inttypes.h>
+
+// Bucket upper bounds in microseconds, roughly 1-2.5-5 steps from 100us to
+// 1s. Everything slower lands in the +Inf bucket.
+static const uint32_t HISTOGRAM_BOUNDS[] = {
+  100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000
+};
+#define HISTOGRAM_BUCKETS (sizeof(HISTOGRAM_BOUNDS) / sizeof(HISTOGRAM_BOUNDS[0]))
+
+// Fixed bucket latency histogram, exported in the Prometheus text format
+// with the bounds converted to seconds.
+struct Histogram {
+  uint32_t buckets[HISTOGRAM_BUCKETS + 1] = {0};
+  uint32_t count = 0;
+  uint64_t sum = 0;
+
+  void observe(uint32_t micros) {
+    unsigned int i = 0;
+    while (i < HISTOGRAM_BUCKETS && micros > HISTOGRAM_BOUNDS[i]) i++;
+    buckets[i]++;
+    count++;
+    sum += micros;
+  }
+
+  // `labels` without the braces, e.g. "bus=\"0\"", or "" for none
+  void write(Print &out, const char *name, const char *labels) const {
+    char line[120];
+    const char *sep = labels[0] ? "," : "";
+    uint32_t cumulative = 0;
+
+    for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; i++) {
+      cumulative += buckets[i];
+      snprintf(line, sizeof(line), "%s_bucket{%s%sle=\"%" PRIu32 ".%06" PRIu32 "\"} %" PRIu32 "\n",
+        name, labels, sep, HISTOGRAM_BOUNDS[i] / 1000000, HISTOGRAM_BOUNDS[i] % 1000000, cumulative);
+      out.print(line);
+    }
+    snprintf(line, sizeof(line), "%s_bucket{%s%sle=\"+Inf\"} %" PRIu32 "\n", name, labels, sep, count);
+    out.print(line);
+    snprintf(line, sizeof(line), "%s_sum{%s} %lu.%06lu\n", name, labels,
+      static_cast<unsigned long>(sum / 1000000), static_cast<unsigned long>(sum % 1000000));
+    out.print(line);
+    snprintf(line, sizeof(line), "%s_count{%s} %" PRIu32 "\n", name, labels, count);
+    out.print(line);
+  }
+};
+
+#endif // HISTOGRAM_H_
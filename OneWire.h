@@ -16,6 +16,14 @@
 
 
 
+// Select the CRC implementation. 0 computes the CRC bit by bit, which is
+// the smallest, 1 uses 256 entry lookup tables in flash, which is the
+// fastest, and 2 uses a pair of 16 entry tables per CRC, one lookup per
+// nibble, as a middle ground.
+#ifndef ONEWIRE_CRC_TABLE
+#define ONEWIRE_CRC_TABLE 1
+#endif
+
 // You can allow 16-bit CRC checks by defining this to 1
 // (Note that ONEWIRE_CRC must also be 1.)
 #ifndef ONEWIRE_CRC16
@@ -28,10 +36,10 @@
 
 class OneWire
 {
-private:
+protected:
   uint16_t _pin;
 
-/**************Conditional fast pin access for Core and Photon*****************/
+/**************Conditional fast pin access for Core, Photon and host**********/
   #if PLATFORM_ID == 0 // Core
     inline void digitalWriteFastLow() {
       PIN_MAP[_pin].gpio_peripheral->BRR = PIN_MAP[_pin].gpio_pin;
@@ -99,28 +107,49 @@ private:
       PIN_MAP[_pin].gpio_peripheral->BSRRL = PIN_MAP[_pin].gpio_pin;
     }
 
+    // Straight to the MODER bits, two a pin, 01 output and 00 input.
+    // HAL_Pin_Mode() takes microseconds, longer than an overdrive read
+    // slot leaves. Callers hold interrupts off over the read-modify-write.
     inline void pinModeFastOutput(void){
-      // This could probably be speed up by digging a little deeper past
-      // the HAL_Pin_Mode function.
-      HAL_Pin_Mode(_pin, OUTPUT);
+      GPIO_TypeDef *port = PIN_MAP[_pin].gpio_peripheral;
+      uint8_t shift = 2 * PIN_MAP[_pin].gpio_pin_source;
+
+      port->MODER = (port->MODER & ~(3UL << shift)) | (1UL << shift);
     }
 
     inline void pinModeFastInput(void){
-      // This could probably be speed up by digging a little deeper past
-      // the HAL_Pin_Mode function.
-      HAL_Pin_Mode(_pin, INPUT);
+      PIN_MAP[_pin].gpio_peripheral->MODER &= ~(3UL << (2 * PIN_MAP[_pin].gpio_pin_source));
     }
 
     inline uint8_t digitalReadFast(void){
-      // This could probably be speed up by digging a little deeper past
-      // the HAL_GPIO_Read function.
-      return HAL_GPIO_Read(_pin);
+      return (PIN_MAP[_pin].gpio_peripheral->IDR & PIN_MAP[_pin].gpio_pin) != 0;
+    }
+
+  #elif PLATFORM_ID == 3 // host build, see host/application.h
+    inline void digitalWriteFastLow() {
+      digitalWrite(_pin, LOW);
+    }
+
+    inline void digitalWriteFastHigh() {
+      digitalWrite(_pin, HIGH);
+    }
+
+    inline void pinModeFastOutput() {
+      pinMode(_pin, OUTPUT);
+    }
+
+    inline void pinModeFastInput() {
+      pinMode(_pin, INPUT);
+    }
+
+    inline uint8_t digitalReadFast() {
+      return digitalRead(_pin);
     }
 
   #else
     #error "*** PLATFORM_ID not supported by this library. PLATFORM should be Core or Photon ***"
   #endif
-/**************End conditional fast pin access for Core and Photon*************/
+/**************End conditional fast pin access for Core, Photon and host******/
 
 #if ONEWIRE_SEARCH
     // global search state
@@ -130,13 +159,27 @@ private:
     uint8_t LastDeviceFlag;
 #endif
 
+    // Slot timings in use, see set_overdrive()
+    bool _overdrive = false;
+
+    // For bus implementations that don't drive a GPIO pin themselves
+    OneWire() : _pin(0) {}
+
+    // Whether this bus implementation can run overdrive slot timings
+    virtual bool can_overdrive(void) { return true; }
+
   public:
     OneWire( uint16_t pin);
+    virtual ~OneWire() {}
+
+    // The bus primitives below are virtual so other bus implementations
+    // (see OneWireUart) can stand in for the bit-banged one. Everything
+    // else, including search, is built on top of them.
 
     // Perform a 1-Wire reset cycle. Returns 1 if a device responds
     // with a presence pulse.  Returns 0 if there is no device or the
     // bus is shorted or otherwise held low for more than 250uS
-    uint8_t reset(void);
+    virtual uint8_t reset(void);
 
     // Issue a 1-Wire rom select command, you do the reset first.
     void select(const uint8_t rom[8]);
@@ -144,32 +187,58 @@ private:
     // Issue a 1-Wire rom skip command, to address all on bus.
     void skip(void);
 
+    // Switch the master between standard and overdrive (about 10x faster)
+    // slot timings for reset(), write_bit() and read_bit(). Devices only
+    // follow after overdrive_skip() or overdrive_select(), and every device
+    // drops back to standard speed on a standard speed reset. Returns 0 if
+    // overdrive was asked for and this bus can't do it.
+    uint8_t set_overdrive(bool on);
+    bool overdrive(void) { return _overdrive; }
+
+    // Overdrive Skip ROM (0x3C). Does a standard speed reset itself, then
+    // every overdrive capable device moves to overdrive along with the
+    // master. The rest sit out until the next standard speed reset, so an
+    // overdrive reset() or search() after this only sees capable devices.
+    // Returns 0 if nothing answered the reset or the bus can't do overdrive.
+    uint8_t overdrive_skip(void);
+
+    // Overdrive Match ROM (0x69). Does a standard speed reset itself, then
+    // selects the device with this ROM and moves it and the master to
+    // overdrive, ready for a function command. Returns 0 if nothing answered
+    // the reset or the bus can't do overdrive.
+    uint8_t overdrive_select(const uint8_t rom[8]);
+
+    // Read the ROM of the only device on the bus, doing the reset itself.
+    // Returns 0 if nothing answered. With more than one device on the bus
+    // the ROMs get ANDed together, so check the CRC.
+    uint8_t read_rom(uint8_t rom[8]);
+
     // Write a byte. If 'power' is one then the wire is held high at
     // the end for parasitically powered devices. You are responsible
     // for eventually depowering it by calling depower() or doing
     // another read or write.
-    void write(uint8_t v, uint8_t power = 0);
+    virtual void write(uint8_t v, uint8_t power = 0);
 
-    void write_bytes(const uint8_t *buf, uint16_t count, bool power = 0);
+    virtual void write_bytes(const uint8_t *buf, uint16_t count, bool power = 0);
 
     // Read a byte.
-    uint8_t read(void);
+    virtual uint8_t read(void);
 
     void read_bytes(uint8_t *buf, uint16_t count);
 
     // Write a bit. The bus is always left powered at the end, see
     // note in write() about that.
-    void write_bit(uint8_t v);
+    virtual void write_bit(uint8_t v);
 
     // Read a bit.
-    uint8_t read_bit(void);
+    virtual uint8_t read_bit(void);
 
     // Stop forcing power onto the bus. You only need to do this if
     // you used the 'power' flag to write() or used a write_bit() call
     // and aren't about to do another read or write. You would rather
     // not leave this powered if you don't have to, just in case
     // someone shorts your bus.
-    void depower(void);
+    virtual void depower(void);
 
 #if ONEWIRE_SEARCH
     // Clear the search state so that if will start from the beginning again.
@@ -184,8 +253,18 @@ private:
     // no devices, or you have already retrieved all of them.  It
     // might be a good idea to check the CRC to make sure you didn't
     // get garbage.  The order is deterministic. You will always get
-    // the same devices in the same order.
-    uint8_t search(uint8_t *newAddr);
+    // the same devices in the same order. With search_mode false only
+    // devices with their alarm flag set answer (Alarm Search, 0xEC).
+    uint8_t search(uint8_t *newAddr, bool search_mode = true);
+
+    // Running count of the discrepancies (bits where devices disagreed)
+    // the search has had to resolve, for bus health monitoring.
+    uint32_t search_discrepancies = 0;
+
+    // Check that the device with this ROM is still on the bus by running a
+    // single search pass forced down its path. Returns 1 if it answered.
+    // Resets the search state.
+    uint8_t verify(const uint8_t rom[8]);
 #endif
 
 #if ONEWIRE_CRC
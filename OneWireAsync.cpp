@@ -0,0 +1,296 @@
+#include "OneWireAsync.h"
+#include "application.h"
+
+#if ONEWIRE_ASYNC
+
+OneWireAsync* OneWireAsync::instance = NULL;
+
+OneWireAsync::OneWireAsync(uint16_t pin): OneWire(pin) {
+    instance = this;
+}
+
+/**************Timer setup for the Photon and the host build*******************/
+#if PLATFORM_ID == 6 // Photon
+void OneWireAsync::begin() {
+    TIM_TimeBaseInitTypeDef timerInit;
+    NVIC_InitTypeDef nvicInit;
+
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM4, ENABLE);
+
+    // APB1 timers run at half the core clock, tick once a microsecond and
+    // stop after every period so each phase arms its own delay.
+    TIM_TimeBaseStructInit(&timerInit);
+    timerInit.TIM_Prescaler = (SystemCoreClock / 2 / 1000000) - 1;
+    timerInit.TIM_Period = 0xFFFF;
+    timerInit.TIM_CounterMode = TIM_CounterMode_Up;
+    TIM_TimeBaseInit(TIM4, &timerInit);
+    TIM_SelectOnePulseMode(TIM4, TIM_OPMode_Single);
+    TIM_ClearITPendingBit(TIM4, TIM_IT_Update);
+    TIM_ITConfig(TIM4, TIM_IT_Update, ENABLE);
+
+    attachSystemInterrupt(SysInterrupt_TIM4_IRQ, isr);
+
+    nvicInit.NVIC_IRQChannel = TIM4_IRQn;
+    nvicInit.NVIC_IRQChannelPreemptionPriority = 10;
+    nvicInit.NVIC_IRQChannelSubPriority = 0;
+    nvicInit.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&nvicInit);
+}
+
+void OneWireAsync::arm(uint16_t us) {
+    if (us < 2) us = 2; // the counter won't run with a zero reload value
+    TIM4->ARR = us - 1;
+    TIM4->CNT = 0;
+    TIM4->CR1 |= TIM_CR1_CEN;
+}
+
+void OneWireAsync::isr() {
+    if (TIM_GetITStatus(TIM4, TIM_IT_Update) == RESET) return;
+    TIM_ClearITPendingBit(TIM4, TIM_IT_Update);
+
+    instance->fired();
+}
+#elif PLATFORM_ID == 3 // host build, see host/application.h
+void OneWireAsync::begin() {
+}
+
+void OneWireAsync::arm(uint16_t us) {
+    hostTimerArm(us, isr);
+}
+
+void OneWireAsync::isr() {
+    instance->fired();
+}
+#endif
+/**************End timer setup*************************************************/
+
+//
+// The delay armed last has run out: on to the next phase, or stop the
+// timer once the queue is done.
+//
+void OneWireAsync::fired() {
+    uint16_t us = tick();
+
+    if (us) {
+        arm(us);
+    } else {
+        running = false;
+    }
+}
+
+//
+// Start the timer if it isn't already. The interrupt only ever clears
+// `running` from inside the handler, so checking it with interrupts off
+// can't miss an operation that was just queued.
+//
+void OneWireAsync::kick() {
+    noInterrupts();
+    if (!running) {
+        running = true;
+        arm(1);
+    }
+    interrupts();
+}
+
+bool OneWireAsync::queue(uint8_t type, uint8_t value) {
+    OneWireOp next = { type, value };
+
+    if (!ops.push(next)) return false;
+
+    kick();
+    return true;
+}
+
+bool OneWireAsync::queueReset() {
+    return queue(ONEWIRE_OP_RESET);
+}
+
+bool OneWireAsync::queueWrite(uint8_t v, uint8_t power /* = 0 */) {
+    return queue(power ? ONEWIRE_OP_WRITE_POWER : ONEWIRE_OP_WRITE, v);
+}
+
+bool OneWireAsync::queueWriteBytes(const uint8_t *buf, uint16_t count) {
+    for (uint16_t i = 0 ; i < count ; i++) {
+        if (!queueWrite(buf[i])) return false;
+    }
+    return true;
+}
+
+bool OneWireAsync::queueRead(uint16_t count /* = 1 */) {
+    for (uint16_t i = 0 ; i < count ; i++) {
+        if (!queue(ONEWIRE_OP_READ)) return false;
+    }
+    return true;
+}
+
+bool OneWireAsync::queueWriteBit(uint8_t v) {
+    return queue(ONEWIRE_OP_WRITE_BIT, v & 1);
+}
+
+bool OneWireAsync::queueReadBit() {
+    return queue(ONEWIRE_OP_READ_BIT);
+}
+
+bool OneWireAsync::queueSelect(const uint8_t rom[8]) {
+    return queueWrite(0x55) && queueWriteBytes(rom, 8); // Choose ROM
+}
+
+bool OneWireAsync::queueSkip() {
+    return queueWrite(0xCC); // Skip ROM
+}
+
+bool OneWireAsync::result(uint8_t &value) {
+    return results.pop(value);
+}
+
+bool OneWireAsync::idle() {
+    return !running && ops.empty();
+}
+
+//
+// The bit engine. Every call runs one phase of a slot and returns how long
+// to wait before the next. Everything from the falling edge of a slot to
+// its release or sample point is done inline with interrupts off, since a
+// late release stretches a 0 past the 120us a slot may last and a late
+// sample misses the presence pulse. Only the reset low, which may run
+// long, and the recovery periods go back to the timer.
+//
+uint16_t OneWireAsync::tick() {
+    uint8_t presence;
+
+    switch (phase) {
+    case PHASE_IDLE:
+        return nextOp();
+
+    case PHASE_RESET_RELEASE:
+        noInterrupts();
+
+        pinModeFastInput();    // allow it to float
+
+        delayMicroseconds(70);
+
+        presence = !digitalReadFast();
+
+        interrupts();
+
+        results.push(presence);
+
+        phase = PHASE_RESET_RECOVER;
+        return 410;
+
+    case PHASE_RESET_RECOVER:
+        phase = PHASE_IDLE;
+        return nextOp();
+
+    case PHASE_RECOVER:
+        bitMask <<= 1;
+        if (bitMask && (op.type == ONEWIRE_OP_WRITE || op.type == ONEWIRE_OP_WRITE_POWER || op.type == ONEWIRE_OP_READ)) {
+            return startSlot();
+        }
+        return finishOp();
+    }
+    return 0;
+}
+
+uint16_t OneWireAsync::nextOp() {
+    if (!ops.pop(op)) return 0;
+
+    bitMask = 0x01;
+    value = 0;
+
+    if (op.type != ONEWIRE_OP_RESET) return startSlot();
+
+    noInterrupts();
+    pinModeFastInput();
+    interrupts();
+
+    // A bus held low is broken or shorted, report no presence
+    if (!digitalReadFast()) {
+        results.push(0);
+        return 1;
+    }
+
+    noInterrupts();
+    digitalWriteFastLow();
+    pinModeFastOutput();   // drive output low
+    interrupts();
+
+    phase = PHASE_RESET_RELEASE;
+    return 480;
+}
+
+uint16_t OneWireAsync::startSlot() {
+    uint8_t bit;
+
+    if (op.type == ONEWIRE_OP_READ || op.type == ONEWIRE_OP_READ_BIT) {
+        noInterrupts();
+
+        pinModeFastOutput();
+        digitalWriteFastLow();
+
+        delayMicroseconds(3);
+
+        pinModeFastInput();    // let pin float, pull up will raise
+
+        delayMicroseconds(10);
+
+        bit = digitalReadFast();
+
+        interrupts();
+
+        if (bit) value |= bitMask;
+
+        phase = PHASE_RECOVER;
+        return 53;
+    }
+
+    bit = (op.type == ONEWIRE_OP_WRITE_BIT) ? op.value : (op.value & bitMask);
+
+    noInterrupts();
+
+    digitalWriteFastLow();
+    pinModeFastOutput();   // drive output low
+
+    if (bit) {
+        delayMicroseconds(10);
+
+        digitalWriteFastHigh();    // drive output high
+
+        interrupts();
+
+        phase = PHASE_RECOVER;
+        return 55;
+    }
+
+    delayMicroseconds(65);
+
+    digitalWriteFastHigh();    // drive output high
+
+    interrupts();
+
+    phase = PHASE_RECOVER;
+    return 5;
+}
+
+uint16_t OneWireAsync::finishOp() {
+    switch (op.type) {
+    case ONEWIRE_OP_READ:
+    case ONEWIRE_OP_READ_BIT:
+        results.push(value);
+        break;
+    case ONEWIRE_OP_WRITE:
+        // Same as write() without power, go tri-state at the end
+        noInterrupts();
+
+        pinModeFastInput();
+        digitalWriteFastLow();
+
+        interrupts();
+        break;
+    }
+
+    phase = PHASE_IDLE;
+    return nextOp();
+}
+
+#endif // ONEWIRE_ASYNC
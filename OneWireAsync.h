@@ -0,0 +1,112 @@
+#ifndef OneWireAsync_h
+#define OneWireAsync_h
+
+#include "OneWire.h"
+
+// The bit engine needs a timer interrupt: TIM4 on the Photon, and the
+// virtual timer in the host build. Elsewhere there is no OneWireAsync.
+#ifndef ONEWIRE_ASYNC
+#if PLATFORM_ID == 6 || PLATFORM_ID == 3
+#define ONEWIRE_ASYNC 1
+#else
+#define ONEWIRE_ASYNC 0
+#endif
+#endif
+
+#if ONEWIRE_ASYNC
+
+#include "SpscRing.h"
+
+#define ONEWIRE_ASYNC_QUEUE_SIZE 64
+
+// Byte level operations queued for the timer driven bit engine
+enum OneWireOpType {
+  ONEWIRE_OP_RESET,
+  ONEWIRE_OP_WRITE,
+  ONEWIRE_OP_WRITE_POWER,
+  ONEWIRE_OP_READ,
+  ONEWIRE_OP_WRITE_BIT,
+  ONEWIRE_OP_READ_BIT
+};
+
+struct OneWireOp {
+  uint8_t type;
+  uint8_t value;
+};
+
+// OneWire bus whose slots are timed by a hardware timer interrupt instead
+// of busy waiting. Transactions are queued from loop() and run in the
+// background; resets and reads each leave one result behind, in order, to
+// be collected with result(). Each slot, up to the point where the line
+// is released or sampled, runs with interrupts off so no other handler can
+// stretch it out of spec; the reset low and the recovery time after each
+// slot are left to the timer, so the main loop keeps running while the
+// bus is busy.
+//
+// The blocking OneWire API still works, as long as the queue is idle.
+// Queued transactions always run at standard speed.
+// Only one instance can exist, it owns TIM4 (the host build's timer, see
+// hostTimerArm(), on the host).
+class OneWireAsync : public OneWire
+{
+  private:
+    enum Phase {
+      PHASE_IDLE,
+      PHASE_RESET_RELEASE,
+      PHASE_RESET_RECOVER,
+      PHASE_RECOVER
+    };
+
+    static OneWireAsync* instance;
+
+    SpscRing<OneWireOp, ONEWIRE_ASYNC_QUEUE_SIZE> ops;
+    SpscRing<uint8_t, ONEWIRE_ASYNC_QUEUE_SIZE> results;
+    volatile bool running = false;
+
+    OneWireOp op;
+    Phase phase = PHASE_IDLE;
+    uint8_t bitMask;
+    uint8_t value;
+
+    uint16_t nextOp();
+    uint16_t startSlot();
+    uint16_t finishOp();
+    void arm(uint16_t us);
+    void fired();
+    void kick();
+    bool queue(uint8_t type, uint8_t value = 0);
+
+    static void isr();
+
+  public:
+    OneWireAsync(uint16_t pin);
+
+    // Set up the timer. Call once from setup().
+    void begin();
+
+    // Queue a transaction. These return false if the queue is full.
+    bool queueReset();
+    bool queueWrite(uint8_t v, uint8_t power = 0);
+    bool queueWriteBytes(const uint8_t *buf, uint16_t count);
+    bool queueRead(uint16_t count = 1);
+    bool queueWriteBit(uint8_t v);
+    bool queueReadBit();
+    bool queueSelect(const uint8_t rom[8]);
+    bool queueSkip();
+
+    // Collect the next result: the presence flag of a reset, a byte read or
+    // a bit read. Returns false if nothing has finished yet.
+    bool result(uint8_t &value);
+
+    // True once every queued transaction has finished
+    bool idle();
+
+    // Run one phase of the current slot and return the microseconds until
+    // the next one, or 0 when there is nothing left to do. This is what the
+    // timer interrupt calls.
+    uint16_t tick();
+};
+
+#endif // ONEWIRE_ASYNC
+
+#endif
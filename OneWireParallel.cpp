@@ -0,0 +1,349 @@
+#include "OneWireParallel.h"
+#include "application.h"
+
+#if ONEWIRE_PARALLEL
+
+OneWireParallel::OneWireParallel(const uint16_t *pins, uint8_t count) {
+    STM32_Pin_Info* PIN_MAP = HAL_Pin_Map();
+
+    port = PIN_MAP[pins[0]].gpio_peripheral;
+
+    for (uint8_t i = 0; i < count && laneCount < ONEWIRE_PARALLEL_LANES; i++) {
+        if (PIN_MAP[pins[i]].gpio_peripheral != port) continue;
+
+        pinMode(pins[i], INPUT);
+        pinMask[laneCount] = PIN_MAP[pins[i]].gpio_pin;
+        outputMode[laneCount] = 1UL << (2 * PIN_MAP[pins[i]].gpio_pin_source);
+        laneBuses[laneCount].parallel = this;
+        laneBuses[laneCount].lane = laneCount;
+        laneCount++;
+    }
+
+    reset_search();
+}
+
+uint8_t OneWireParallel::lanes() {
+    return (1 << laneCount) - 1;
+}
+
+OneWire &OneWireParallel::lane(uint8_t i) {
+    return laneBuses[i];
+}
+
+uint16_t OneWireParallel::pins(uint8_t lanes) {
+    uint16_t mask = 0;
+
+    for (uint8_t lane = 0; lane < laneCount; lane++) {
+        if (lanes & (1 << lane)) mask |= pinMask[lane];
+    }
+    return mask;
+}
+
+// MODER bits that switch these lanes to output, input is all zeroes
+uint32_t OneWireParallel::modes(uint8_t lanes) {
+    uint32_t mode = 0;
+
+    for (uint8_t lane = 0; lane < laneCount; lane++) {
+        if (lanes & (1 << lane)) mode |= outputMode[lane];
+    }
+    return mode;
+}
+
+uint8_t OneWireParallel::sample() {
+    uint16_t idr = port->IDR;
+    uint8_t r = 0;
+
+    for (uint8_t lane = 0; lane < laneCount; lane++) {
+        if (idr & pinMask[lane]) r |= (1 << lane);
+    }
+    return r;
+}
+
+//
+// Perform the onewire reset function on every active lane. A lane whose
+// line doesn't come high is broken or shorted and is left out.
+//
+uint8_t OneWireParallel::reset(uint8_t active /* = 0xFF */) {
+    uint8_t retries = 125;
+    uint16_t drive;
+    uint32_t mode;
+    uint8_t r;
+
+    active &= lanes();
+
+    noInterrupts();
+    port->MODER &= ~(modes(active) * 3);   // both mode bits, all active lanes to input
+    interrupts();
+
+    // wait until the wires are high... just in case
+    while ((sample() & active) != active && --retries) {
+        delayMicroseconds(2);
+    }
+    active &= sample();
+
+    drive = pins(active);
+    mode = modes(active);
+
+    noInterrupts();
+    port->BSRRH = drive;
+    port->MODER |= mode;    // drive output low
+    interrupts();
+
+    delayMicroseconds(480);
+
+    noInterrupts();
+    port->MODER &= ~mode;   // allow them to float
+    delayMicroseconds(70);
+    r = ~sample() & active;
+    interrupts();
+
+    delayMicroseconds(410);
+
+    return r;
+}
+
+//
+// Lanes writing a 1 are released after 10us, lanes writing a 0 are held
+// for the full 65us, all in the same slot. Interrupts stay off until every
+// lane is let go: a handler that ran while the zeros were still held low
+// would stretch them past the 120us a slot may last.
+//
+void OneWireParallel::write_bits(uint8_t bits, uint8_t active /* = 0xFF */) {
+    uint16_t drive;
+    uint32_t mode, ones;
+
+    active &= lanes();
+    drive = pins(active);
+    mode = modes(active);
+    ones = modes(active & bits);
+
+    noInterrupts();
+
+    port->BSRRH = drive;
+    port->MODER |= mode;    // drive output low
+
+    delayMicroseconds(10);
+
+    port->MODER &= ~ones;   // let the ones float, pull up will raise
+
+    delayMicroseconds(55);
+
+    port->MODER &= ~mode;
+
+    interrupts();
+
+    delayMicroseconds(5);
+}
+
+uint8_t OneWireParallel::read_bits(uint8_t active /* = 0xFF */) {
+    uint16_t drive;
+    uint32_t mode;
+    uint8_t r;
+
+    active &= lanes();
+    drive = pins(active);
+    mode = modes(active);
+
+    noInterrupts();
+
+    port->BSRRH = drive;
+    port->MODER |= mode;
+
+    delayMicroseconds(3);
+
+    port->MODER &= ~mode;   // let pins float, pull up will raise
+
+    delayMicroseconds(10);
+
+    r = sample() & active;
+
+    interrupts();
+    delayMicroseconds(53);
+
+    return r;
+}
+
+void OneWireParallel::write(uint8_t v, uint8_t active /* = 0xFF */) {
+    for (uint8_t bitMask = 0x01; bitMask; bitMask <<= 1) {
+        write_bits((bitMask & v) ? 0xFF : 0x00, active);
+    }
+}
+
+void OneWireParallel::write(const uint8_t v[ONEWIRE_PARALLEL_LANES], uint8_t active /* = 0xFF */) {
+    for (uint8_t bitMask = 0x01; bitMask; bitMask <<= 1) {
+        uint8_t bits = 0;
+
+        for (uint8_t lane = 0; lane < laneCount; lane++) {
+            if (v[lane] & bitMask) bits |= (1 << lane);
+        }
+        write_bits(bits, active);
+    }
+}
+
+void OneWireParallel::read(uint8_t v[ONEWIRE_PARALLEL_LANES], uint8_t active /* = 0xFF */) {
+    for (uint8_t lane = 0; lane < laneCount; lane++) v[lane] = 0;
+
+    for (uint8_t bitMask = 0x01; bitMask; bitMask <<= 1) {
+        uint8_t bits = read_bits(active);
+
+        for (uint8_t lane = 0; lane < laneCount; lane++) {
+            if (bits & (1 << lane)) v[lane] |= bitMask;
+        }
+    }
+}
+
+void OneWireParallel::skip(uint8_t active /* = 0xFF */) {
+    write(0xCC, active);           // Skip ROM
+}
+
+void OneWireParallel::power(uint8_t active /* = 0xFF */) {
+    active &= lanes();
+
+    noInterrupts();
+    port->BSRRL = pins(active);
+    port->MODER |= modes(active);
+    interrupts();
+}
+
+void OneWireParallel::depower(uint8_t active /* = 0xFF */) {
+    noInterrupts();
+    port->MODER &= ~(modes(active & lanes()) * 3);
+    interrupts();
+}
+
+void OneWireParallel::select(const uint8_t roms[ONEWIRE_PARALLEL_LANES][8], uint8_t active /* = 0xFF */) {
+    uint8_t v[ONEWIRE_PARALLEL_LANES];
+
+    write(0x55, active);           // Choose ROM
+
+    for (uint8_t i = 0; i < 8; i++) {
+        for (uint8_t lane = 0; lane < laneCount; lane++) v[lane] = roms[lane][i];
+        write(v, active);
+    }
+}
+
+void OneWireParallel::reset_search() {
+    for (uint8_t lane = 0; lane < ONEWIRE_PARALLEL_LANES; lane++) {
+        LastDiscrepancy[lane] = 0;
+        for (uint8_t i = 0; i < 8; i++) ROM_NO[lane][i] = 0;
+    }
+    searchDone = 0;
+}
+
+//
+// The Dallas search algorithm from OneWire::search, run on every lane at
+// once: each step reads the id bit and its complement on all lanes with
+// two slots, picks a direction per lane and writes them all back in one.
+// A lane drops out as soon as nothing answers on it.
+//
+uint8_t OneWireParallel::search(uint8_t newAddr[ONEWIRE_PARALLEL_LANES][8]) {
+    uint8_t last_zero[ONEWIRE_PARALLEL_LANES] = {0};
+    uint8_t active = lanes() & ~searchDone;
+    uint8_t found;
+
+    if (!active) return 0;
+
+    active &= reset(active);
+    write(0xF0, active);           // NORMAL SEARCH
+
+    for (uint8_t id_bit_number = 1; id_bit_number <= 64 && active; id_bit_number++) {
+        uint8_t rom_byte_number = (id_bit_number - 1) >> 3;
+        uint8_t rom_byte_mask = 1 << ((id_bit_number - 1) & 7);
+        uint8_t id_bits = read_bits(active);
+        uint8_t cmp_id_bits = read_bits(active);
+        uint8_t directions = 0;
+
+        for (uint8_t lane = 0; lane < laneCount; lane++) {
+            uint8_t laneBit = 1 << lane;
+            uint8_t id_bit = (id_bits & laneBit) != 0;
+            uint8_t cmp_id_bit = (cmp_id_bits & laneBit) != 0;
+            uint8_t search_direction;
+
+            if (!(active & laneBit)) continue;
+
+            // check for no devices on this lane
+            if (id_bit && cmp_id_bit) {
+                active &= ~laneBit;
+                continue;
+            }
+
+            if (id_bit != cmp_id_bit) {
+                search_direction = id_bit;  // all devices coupled have 0 or 1
+            } else {
+                // discrepancy, same rules as the single bus search
+                if (id_bit_number < LastDiscrepancy[lane])
+                    search_direction = ((ROM_NO[lane][rom_byte_number] & rom_byte_mask) > 0);
+                else
+                    search_direction = (id_bit_number == LastDiscrepancy[lane]);
+
+                if (search_direction == 0) last_zero[lane] = id_bit_number;
+            }
+
+            if (search_direction) {
+                ROM_NO[lane][rom_byte_number] |= rom_byte_mask;
+                directions |= laneBit;
+            } else {
+                ROM_NO[lane][rom_byte_number] &= ~rom_byte_mask;
+            }
+        }
+
+        write_bits(directions, active);
+    }
+
+    // lanes still active made it through all 64 bits
+    found = active;
+    for (uint8_t lane = 0; lane < laneCount; lane++) {
+        uint8_t laneBit = 1 << lane;
+
+        if (!(lanes() & ~searchDone & laneBit)) continue;
+
+        if (found & laneBit) {
+            LastDiscrepancy[lane] = last_zero[lane];
+            if (LastDiscrepancy[lane] == 0) searchDone |= laneBit; // last device
+            for (uint8_t i = 0; i < 8; i++) newAddr[lane][i] = ROM_NO[lane][i];
+        } else {
+            searchDone |= laneBit;
+        }
+    }
+
+    return found;
+}
+
+/**************One lane as a OneWire******************************************/
+
+uint8_t OneWireLane::reset(void) {
+    return parallel->reset(1 << lane) != 0;
+}
+
+void OneWireLane::write(uint8_t v, uint8_t power /* = 0 */) {
+    parallel->write(v, 1 << lane);
+    if (power) parallel->power(1 << lane);
+}
+
+void OneWireLane::write_bytes(const uint8_t *buf, uint16_t count, bool power /* = 0 */) {
+    for (uint16_t i = 0 ; i < count ; i++)
+        parallel->write(buf[i], 1 << lane);
+
+    if (power) parallel->power(1 << lane);
+}
+
+uint8_t OneWireLane::read(void) {
+    uint8_t v[ONEWIRE_PARALLEL_LANES];
+
+    parallel->read(v, 1 << lane);
+    return v[lane];
+}
+
+void OneWireLane::write_bit(uint8_t v) {
+    parallel->write_bits(v ? 0xFF : 0x00, 1 << lane);
+}
+
+uint8_t OneWireLane::read_bit(void) {
+    return parallel->read_bits(1 << lane) != 0;
+}
+
+void OneWireLane::depower(void) {
+    parallel->depower(1 << lane);
+}
+
+#endif // ONEWIRE_PARALLEL
@@ -0,0 +1,129 @@
+#ifndef OneWireParallel_h
+#define OneWireParallel_h
+
+#include <inttypes.h>
+#include "application.h"
+#include "OneWire.h"
+
+// The lanes are driven through the STM32F2's GPIO registers: the Photon's,
+// and the ones the host build simulates. Elsewhere there is no
+// OneWireParallel.
+#ifndef ONEWIRE_PARALLEL
+#if PLATFORM_ID == 6 || PLATFORM_ID == 3
+#define ONEWIRE_PARALLEL 1
+#else
+#define ONEWIRE_PARALLEL 0
+#endif
+#endif
+
+#if ONEWIRE_PARALLEL
+
+#define ONEWIRE_PARALLEL_LANES 8
+
+class OneWireParallel;
+
+// One lane of a OneWireParallel as an ordinary OneWire bus, for what
+// Sensors does one bus at a time: searches, setup and conversions.
+class OneWireLane : public OneWire
+{
+  private:
+    OneWireParallel *parallel = NULL;
+    uint8_t lane = 0;
+
+    friend class OneWireParallel;
+
+  protected:
+    // OneWireParallel only has standard speed slots
+    bool can_overdrive(void) { return false; }
+
+  public:
+    OneWireLane() {}
+
+    uint8_t reset(void);
+    void write(uint8_t v, uint8_t power = 0);
+    void write_bytes(const uint8_t *buf, uint16_t count, bool power = 0);
+    uint8_t read(void);
+    void write_bit(uint8_t v);
+    uint8_t read_bit(void);
+    void depower(void);
+};
+
+// Bit-banged OneWire on up to 8 pins ("lanes") of the same GPIO port at
+// once. Each slot is started and released for every lane with a single
+// port register write and sampled with a single port read, so 8 buses
+// take the time of one. Every lane carries its own data: bytes are passed
+// as one per lane and read results come back as a bitmask or one byte per
+// lane, and the ROM search runs independently on each lane.
+//
+// Most calls take an `active` lane mask; lanes outside it are left alone.
+// Pins that aren't on the same port as the first one are dropped, check
+// lanes() after construction. Each lane is also a OneWire of its own, see
+// lane().
+class OneWireParallel
+{
+  private:
+    GPIO_TypeDef* port;
+    OneWireLane laneBuses[ONEWIRE_PARALLEL_LANES];
+    uint16_t pinMask[ONEWIRE_PARALLEL_LANES]; // port bit of each lane
+    uint32_t outputMode[ONEWIRE_PARALLEL_LANES]; // MODER output bits of each lane
+    uint8_t laneCount = 0;
+
+    // per lane search state
+    uint8_t ROM_NO[ONEWIRE_PARALLEL_LANES][8];
+    uint8_t LastDiscrepancy[ONEWIRE_PARALLEL_LANES];
+    uint8_t searchDone;
+
+    uint16_t pins(uint8_t lanes);
+    uint32_t modes(uint8_t lanes);
+    uint8_t sample();
+
+  public:
+    OneWireParallel(const uint16_t *pins, uint8_t count);
+
+    // Bitmask of the lanes that are in use
+    uint8_t lanes();
+
+    // Lane i on its own
+    OneWire &lane(uint8_t i);
+
+    // Reset every active lane. Returns the mask of lanes that saw a
+    // presence pulse.
+    uint8_t reset(uint8_t active = 0xFF);
+
+    // One write slot per active lane, lane i writing bit i of `bits`
+    void write_bits(uint8_t bits, uint8_t active = 0xFF);
+
+    // One read slot per active lane, returns bit i for lane i
+    uint8_t read_bits(uint8_t active = 0xFF);
+
+    // Write the same byte on every active lane
+    void write(uint8_t v, uint8_t active = 0xFF);
+
+    // Write a byte per lane, v[i] goes to lane i
+    void write(const uint8_t v[ONEWIRE_PARALLEL_LANES], uint8_t active = 0xFF);
+
+    // Read a byte per lane into v[i]
+    void read(uint8_t v[ONEWIRE_PARALLEL_LANES], uint8_t active = 0xFF);
+
+    void skip(uint8_t active = 0xFF);
+
+    // Drive the active lanes high, for parasite powered devices to convert
+    // on. The next reset or slot on a lane, or depower(), lets it go.
+    void power(uint8_t active = 0xFF);
+    void depower(uint8_t active = 0xFF);
+
+    // Select roms[i] on lane i
+    void select(const uint8_t roms[ONEWIRE_PARALLEL_LANES][8], uint8_t active = 0xFF);
+
+    // Start the search over on every lane
+    void reset_search();
+
+    // Find the next device on every lane that still has one. Returns the
+    // mask of lanes where newAddr[i] holds a new ROM, 0 once every lane
+    // has been fully enumerated (until reset_search() is called).
+    uint8_t search(uint8_t newAddr[ONEWIRE_PARALLEL_LANES][8]);
+};
+
+#endif // ONEWIRE_PARALLEL
+
+#endif
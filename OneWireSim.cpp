@@ -0,0 +1,463 @@
+#include "OneWireSim.h"
+#include "application.h"
+#include <math.h>
+
+// Slot times, for the bus time estimate
+#define SIM_RESET_MICROS 960
+#define SIM_SLOT_MICROS 70
+#define SIM_OVERDRIVE_RESET_MICROS 118
+#define SIM_OVERDRIVE_SLOT_MICROS 10
+
+static const uint8_t SIM_FAMILY[] = { 0x28, 0x10, 0x26, 0x42 };
+static const uint16_t SIM_DS18B20_CONVERSION[] = { 94, 188, 375, 750 };
+
+static uint8_t romBit(const uint8_t rom[8], uint16_t bit) {
+    return (rom[bit >> 3] >> (bit & 7)) & 1;
+}
+
+int OneWireSim::addDevice(SimDeviceModel model, uint32_t serial, float celsius, bool parasite /* = false */) {
+    if (deviceCount >= ONEWIRE_SIM_MAX_DEVICES) return -1;
+
+    SimDevice &d = devices[deviceCount];
+
+    memset(&d, 0, sizeof(d));
+    d.model = model;
+    d.celsius = celsius;
+    d.parasite = parasite;
+    d.present = true;
+
+    d.rom[0] = SIM_FAMILY[model];
+    for (uint8_t i = 0; i < 4; i++) d.rom[i + 1] = (serial >> (8 * i)) & 0xFF;
+    d.rom[7] = crc8(d.rom, 7);
+
+    // Power on register contents, including the infamous 85C reading
+    switch (model) {
+    case SIM_DS18B20:
+    case SIM_DS28EA00:
+        d.scratchpad[0] = 0x50;
+        d.scratchpad[1] = 0x05;
+        d.scratchpad[2] = 0x4B; // TH
+        d.scratchpad[3] = 0x46; // TL
+        d.scratchpad[4] = 0x7F; // 12 bit
+        d.scratchpad[5] = 0xFF;
+        d.scratchpad[6] = 0x0C;
+        d.scratchpad[7] = 0x10;
+        break;
+    case SIM_DS18S20:
+        d.scratchpad[0] = 0xAA;
+        d.scratchpad[1] = 0x00;
+        d.scratchpad[2] = 0x4B; // TH
+        d.scratchpad[3] = 0x46; // TL
+        d.scratchpad[4] = 0xFF;
+        d.scratchpad[5] = 0xFF;
+        d.scratchpad[6] = 0x0C; // COUNT_REMAIN
+        d.scratchpad[7] = 0x10; // COUNT_PER_C
+        break;
+    case SIM_DS2438:
+        d.scratchpad[0] = 0x0F; // status
+        d.memory[0] = 0x0F;
+        break;
+    }
+    updateCrc(d);
+
+    return deviceCount++;
+}
+
+SimDevice & OneWireSim::device(uint16_t index) {
+    return devices[index];
+}
+
+uint16_t OneWireSim::count() {
+    return deviceCount;
+}
+
+void OneWireSim::setTemperature(uint16_t index, float celsius) {
+    devices[index].celsius = celsius;
+}
+
+void OneWireSim::setPresent(uint16_t index, bool present) {
+    devices[index].present = present;
+}
+
+void OneWireSim::corruptNextReads(uint16_t index, uint8_t reads) {
+    devices[index].corruptReads = reads;
+}
+
+unsigned long long OneWireSim::busMicros() {
+    return elapsedMicros;
+}
+
+void OneWireSim::resetBusMicros() {
+    elapsedMicros = 0;
+}
+
+void OneWireSim::updateCrc(SimDevice &device) {
+    device.scratchpad[8] = crc8(device.scratchpad, 8);
+}
+
+uint16_t OneWireSim::conversionTime(SimDevice &device) {
+    switch (device.model) {
+    case SIM_DS18B20:
+    case SIM_DS28EA00:
+        return SIM_DS18B20_CONVERSION[(device.scratchpad[4] >> 5) & 3];
+    case SIM_DS2438:
+        return 10;
+    default:
+        return 750;
+    }
+}
+
+void OneWireSim::convert(SimDevice &device) {
+    device.converting = true;
+    device.convertStart = millis();
+}
+
+//
+// Latch the temperature into the scratchpad the way each part encodes it
+// and set the alarm flag from TH/TL.
+//
+void OneWireSim::finishConversion(SimDevice &device) {
+    int16_t raw;
+    int8_t whole;
+    int count_remain;
+
+    device.converting = false;
+
+    switch (device.model) {
+    case SIM_DS18B20:
+    case SIM_DS28EA00:
+        raw = static_cast<int16_t>(lround(device.celsius * 16));
+        // undefined low bits at lower resolutions come back as zero
+        raw &= ~((1 << (3 - ((device.scratchpad[4] >> 5) & 3))) - 1);
+        device.scratchpad[0] = raw & 0xFF;
+        device.scratchpad[1] = (raw >> 8) & 0xFF;
+        whole = raw >> 4;
+        break;
+    case SIM_DS18S20:
+        raw = static_cast<int16_t>(floor(device.celsius * 2));
+        whole = raw >> 1;
+        count_remain = 12 - (static_cast<int>(lround(device.celsius * 16)) - whole * 16);
+        if (count_remain < 0) count_remain = 0;
+        if (count_remain > 16) count_remain = 16;
+        device.scratchpad[0] = raw & 0xFF;
+        device.scratchpad[1] = (raw >> 8) & 0xFF;
+        device.scratchpad[6] = count_remain;
+        break;
+    default: // DS2438, into SRAM, the scratchpad keeps what was last recalled
+        whole = static_cast<int8_t>(floor(device.celsius));
+        device.memory[1] = static_cast<uint8_t>((device.celsius - whole) * 32) << 3;
+        device.memory[2] = whole;
+        break;
+    }
+    updateCrc(device);
+
+    device.alarm = device.model != SIM_DS2438 &&
+        (whole >= static_cast<int8_t>(device.scratchpad[2]) ||
+         whole <= static_cast<int8_t>(device.scratchpad[3]));
+}
+
+//
+// A standard speed reset brings every device back to standard speed. An
+// overdrive reset is too short for the devices still at standard speed to
+// notice, so only the ones in overdrive answer it.
+//
+uint8_t OneWireSim::reset(void) {
+    bool presence = false;
+
+    elapsedMicros += _overdrive ? SIM_OVERDRIVE_RESET_MICROS : SIM_RESET_MICROS;
+
+    for (uint16_t i = 0; i < deviceCount; i++) {
+        SimDevice &d = devices[i];
+
+        if (d.converting && millis() - d.convertStart >= conversionTime(d)) {
+            finishConversion(d);
+        }
+        if (!_overdrive) d.overdrive = false;
+        d.active = d.present && d.overdrive == _overdrive;
+        d.corrupting = false;
+        presence = presence || d.active;
+    }
+
+    state = presence ? SIM_ROM_COMMAND : SIM_IDLE;
+    overdriveMatch = false;
+    shift = 0;
+    bitCount = 0;
+    bitIndex = 0;
+
+    return presence;
+}
+
+//
+// What an addressed device puts on the bus during the current slot. A
+// device only ever pulls the line low, so 1 means it leaves it alone.
+//
+uint8_t OneWireSim::deviceBit(SimDevice &device) {
+    uint16_t bit;
+
+    switch (state) {
+    case SIM_READ_ROM:
+        return romBit(device.rom, bitIndex);
+
+    case SIM_SEARCH:
+        if (searchStep == 0) return romBit(device.rom, bitIndex);
+        if (searchStep == 1) return !romBit(device.rom, bitIndex);
+        return 1;
+
+    case SIM_CONVERTING:
+        if (device.converting && millis() - device.convertStart >= conversionTime(device)) {
+            finishConversion(device);
+        }
+        // parasite powered parts can't signal, they're held up by the pullup
+        return device.parasite || !device.converting;
+
+    case SIM_READ_POWER:
+        return !device.parasite;
+
+    case SIM_READ_SCRATCHPAD:
+        // the DS2438 takes a page number before sending anything
+        bit = device.model == SIM_DS2438 ? bitIndex - 8 : bitIndex;
+        if (device.model == SIM_DS2438 && bitIndex < 8) return 1;
+        if (bit >= 72) return 1;
+        if (bit >= 64 && device.corrupting) return !romBit(device.scratchpad, bit);
+        return romBit(device.scratchpad, bit);
+
+    default:
+        return 1;
+    }
+}
+
+//
+// Whether a device takes part in the current slot. One running at the
+// other speed can't make sense of it.
+//
+bool OneWireSim::listening(SimDevice &device) {
+    return device.active && device.overdrive == _overdrive;
+}
+
+//
+// One time slot: the master's bit wire-ANDed with every addressed device,
+// then each device reacts to what was on the line.
+//
+uint8_t OneWireSim::slot(uint8_t master) {
+    uint8_t level = master & 1;
+
+    elapsedMicros += _overdrive ? SIM_OVERDRIVE_SLOT_MICROS : SIM_SLOT_MICROS;
+
+    for (uint16_t i = 0; i < deviceCount; i++) {
+        if (listening(devices[i])) level &= deviceBit(devices[i]);
+    }
+
+    switch (state) {
+    case SIM_ROM_COMMAND:
+    case SIM_FUNCTION:
+    case SIM_WRITE_SCRATCHPAD:
+    case SIM_RECALL_MEMORY:
+        shift |= level << bitCount;
+        if (++bitCount == 8) {
+            uint8_t v = shift;
+
+            shift = 0;
+            bitCount = 0;
+            command(v);
+        }
+        break;
+
+    case SIM_MATCH_ROM:
+        for (uint16_t i = 0; i < deviceCount; i++) {
+            SimDevice &d = devices[i];
+
+            if (!listening(d) || romBit(d.rom, bitIndex) == level) continue;
+
+            // only the matched device stays in overdrive
+            d.active = false;
+            if (overdriveMatch) d.overdrive = false;
+        }
+        if (++bitIndex == 64) state = SIM_FUNCTION;
+        break;
+
+    case SIM_READ_ROM:
+        if (++bitIndex == 64) state = SIM_FUNCTION;
+        break;
+
+    case SIM_SEARCH:
+        if (searchStep < 2) {
+            searchStep++;
+            break;
+        }
+        // devices that don't match the chosen direction drop out
+        for (uint16_t i = 0; i < deviceCount; i++) {
+            if (listening(devices[i]) && romBit(devices[i].rom, bitIndex) != level) devices[i].active = false;
+        }
+        searchStep = 0;
+        if (++bitIndex == 64) state = SIM_FUNCTION;
+        break;
+
+    case SIM_READ_SCRATCHPAD:
+        for (uint16_t i = 0; i < deviceCount; i++) {
+            SimDevice &d = devices[i];
+
+            if (!d.active || d.model != SIM_DS2438 || bitIndex >= 8) continue;
+
+            d.page |= level << bitIndex;
+            if (bitIndex == 7 && d.page != 0) d.active = false; // only page 0 is modelled
+        }
+        bitIndex++;
+        break;
+
+    default:
+        break;
+    }
+
+    return level;
+}
+
+void OneWireSim::command(uint8_t v) {
+    if (state == SIM_ROM_COMMAND) {
+        bitIndex = 0;
+        searchStep = 0;
+
+        switch (v) {
+        case 0x33: // Read ROM
+            state = SIM_READ_ROM;
+            break;
+        case 0x55: // Match ROM
+            state = SIM_MATCH_ROM;
+            break;
+        case 0xCC: // Skip ROM
+            state = SIM_FUNCTION;
+            break;
+        case 0x3C: // Overdrive Skip ROM
+        case 0x69: // Overdrive Match ROM
+            for (uint16_t i = 0; i < deviceCount; i++) {
+                SimDevice &d = devices[i];
+
+                if (!listening(d)) continue;
+
+                if (d.model == SIM_DS28EA00) {
+                    d.overdrive = true;
+                } else {
+                    d.active = false; // waits for the next reset
+                }
+            }
+            overdriveMatch = v == 0x69;
+            state = overdriveMatch ? SIM_MATCH_ROM : SIM_FUNCTION;
+            break;
+        case 0xEC: // Alarm Search
+            for (uint16_t i = 0; i < deviceCount; i++) {
+                if (listening(devices[i]) && !devices[i].alarm) devices[i].active = false;
+            }
+            state = SIM_SEARCH;
+            break;
+        case 0xF0: // Search ROM
+            state = SIM_SEARCH;
+            break;
+        default:
+            state = SIM_IDLE;
+        }
+        return;
+    }
+
+    if (state == SIM_WRITE_SCRATCHPAD) {
+        for (uint16_t i = 0; i < deviceCount; i++) {
+            SimDevice &d = devices[i];
+
+            if (!listening(d)) continue;
+
+            if (bitIndex < 2) {
+                d.scratchpad[2 + bitIndex] = v; // TH, TL
+            } else if (bitIndex == 2 && (d.model == SIM_DS18B20 || d.model == SIM_DS28EA00)) {
+                d.scratchpad[4] = (v & 0x60) | 0x1F; // config
+            }
+            updateCrc(d);
+        }
+        bitIndex++;
+        return;
+    }
+
+    if (state == SIM_RECALL_MEMORY) {
+        for (uint16_t i = 0; i < deviceCount; i++) {
+            SimDevice &d = devices[i];
+
+            if (!listening(d) || v != 0) continue; // only page 0 is modelled
+
+            memcpy(d.scratchpad, d.memory, sizeof(d.memory));
+            updateCrc(d);
+        }
+        state = SIM_IDLE;
+        return;
+    }
+
+    // function commands
+    bitIndex = 0;
+    switch (v) {
+    case 0x44: // Convert T
+        for (uint16_t i = 0; i < deviceCount; i++) {
+            if (listening(devices[i])) convert(devices[i]);
+        }
+        state = SIM_CONVERTING;
+        break;
+    case 0xBE: // Read Scratchpad
+        for (uint16_t i = 0; i < deviceCount; i++) {
+            SimDevice &d = devices[i];
+
+            if (!listening(d)) continue;
+
+            d.page = 0;
+            if (d.corruptReads) {
+                d.corruptReads--;
+                d.corrupting = true;
+            }
+        }
+        state = SIM_READ_SCRATCHPAD;
+        break;
+    case 0x4E: // Write Scratchpad
+        for (uint16_t i = 0; i < deviceCount; i++) {
+            if (devices[i].model == SIM_DS2438) devices[i].active = false;
+        }
+        state = SIM_WRITE_SCRATCHPAD;
+        break;
+    case 0xB4: // Read Power Supply
+        state = SIM_READ_POWER;
+        break;
+    case 0xB8: // Recall Memory on the DS2438, Recall E2 on the rest
+        for (uint16_t i = 0; i < deviceCount; i++) {
+            if (devices[i].model != SIM_DS2438) devices[i].active = false;
+        }
+        state = SIM_RECALL_MEMORY;
+        break;
+    default: // Copy Scratchpad and the rest are no-ops here
+        state = SIM_IDLE;
+    }
+}
+
+void OneWireSim::write_bit(uint8_t v) {
+    slot(v);
+}
+
+uint8_t OneWireSim::read_bit(void) {
+    return slot(1);
+}
+
+//
+// A parasite powered device that starts converting without the strong
+// pullup browns out and never updates its scratchpad.
+//
+void OneWireSim::write(uint8_t v, uint8_t power /* = 0 */) {
+    for (uint8_t bitMask = 0x01; bitMask; bitMask <<= 1) {
+        slot((bitMask & v) ? 1 : 0);
+    }
+
+    if (state == SIM_CONVERTING && !power) {
+        for (uint16_t i = 0; i < deviceCount; i++) {
+            if (listening(devices[i]) && devices[i].parasite) devices[i].converting = false;
+        }
+    }
+}
+
+void OneWireSim::write_bytes(const uint8_t *buf, uint16_t count, bool power /* = 0 */) {
+    for (uint16_t i = 0 ; i < count ; i++)
+        write(buf[i], power);
+}
+
+void OneWireSim::depower(void) {
+}
@@ -0,0 +1,117 @@
+#ifndef OneWireSim_h
+#define OneWireSim_h
+
+#include "OneWire.h"
+
+// 56 bytes a device. The host build has room for the 256 devices
+// bench/sim_bus_bench.cpp goes up to, a Photon running SIMULATED_BUS
+// doesn't.
+#ifndef ONEWIRE_SIM_MAX_DEVICES
+#if PLATFORM_ID == 3
+#define ONEWIRE_SIM_MAX_DEVICES 256
+#else
+#define ONEWIRE_SIM_MAX_DEVICES 32
+#endif
+#endif
+
+enum SimDeviceModel {
+  SIM_DS18B20,
+  SIM_DS18S20,
+  SIM_DS2438,
+  SIM_DS28EA00 // DS18B20 compatible, with overdrive
+};
+
+struct SimDevice {
+  SimDeviceModel model;
+  uint8_t rom[8];
+  uint8_t scratchpad[9];
+  uint8_t memory[8];   // DS2438 page 0 SRAM, where conversions land until Recall Memory
+  float celsius;
+  bool parasite;
+  bool present;        // false makes it miss presence pulses and go silent
+  uint8_t corruptReads; // scratchpad reads still to be sent with a bad CRC
+  bool alarm;
+  bool active;         // still addressed in the current transaction
+  bool overdrive;      // moved to overdrive speed by Overdrive Skip/Match ROM
+  bool corrupting;     // sending a bad CRC in the current read
+  uint8_t page;        // DS2438 page requested by the current read
+  bool converting;
+  unsigned long convertStart;
+};
+
+// A OneWire bus with no wire behind it. It models DS18B20, DS18S20,
+// DS2438 and DS28EA00 devices at the slot level: every write or read slot
+// goes through the same wired-AND the real bus does, so ROM search
+// (discrepancies included), Match/Skip/Read ROM, Alarm Search, conversion
+// latency, the ready bit, Read Power Supply, parasite power, overdrive
+// and scratchpad CRCs all behave as they do on hardware. Faults can be
+// injected per device: dropping off the bus and corrupted scratchpad CRCs.
+//
+// It keeps count of the bus time the same traffic would take on a real
+// bus, see busMicros(), so driver changes can be compared without
+// hardware.
+class OneWireSim : public OneWire
+{
+  private:
+    enum SimState {
+      SIM_IDLE,
+      SIM_ROM_COMMAND,
+      SIM_MATCH_ROM,
+      SIM_READ_ROM,
+      SIM_SEARCH,
+      SIM_FUNCTION,
+      SIM_CONVERTING,
+      SIM_READ_SCRATCHPAD,
+      SIM_WRITE_SCRATCHPAD,
+      SIM_RECALL_MEMORY,
+      SIM_READ_PAGE,
+      SIM_READ_POWER
+    };
+
+    SimDevice devices[ONEWIRE_SIM_MAX_DEVICES];
+    uint16_t deviceCount = 0;
+
+    SimState state = SIM_IDLE;
+    uint8_t shift;
+    uint8_t bitCount;
+    uint16_t bitIndex;
+    uint8_t searchStep;
+    bool overdriveMatch; // the Match ROM in progress is an Overdrive Match
+    unsigned long long elapsedMicros = 0;
+
+    uint8_t slot(uint8_t master);
+    uint8_t deviceBit(SimDevice &device);
+    void command(uint8_t v);
+    void convert(SimDevice &device);
+    void finishConversion(SimDevice &device);
+    void updateCrc(SimDevice &device);
+    uint16_t conversionTime(SimDevice &device);
+    bool listening(SimDevice &device);
+
+  public:
+    OneWireSim() {}
+
+    // Adds a device with the given serial number and returns its index,
+    // or -1 if the bus is full.
+    int addDevice(SimDeviceModel model, uint32_t serial, float celsius, bool parasite = false);
+
+    SimDevice & device(uint16_t index);
+    uint16_t count();
+
+    void setTemperature(uint16_t index, float celsius);
+    void setPresent(uint16_t index, bool present);
+    void corruptNextReads(uint16_t index, uint8_t reads);
+
+    // Modelled bus time since the last resetBusMicros()
+    unsigned long long busMicros();
+    void resetBusMicros();
+
+    uint8_t reset(void);
+    void write(uint8_t v, uint8_t power = 0);
+    void write_bytes(const uint8_t *buf, uint16_t count, bool power = 0);
+    void write_bit(uint8_t v);
+    uint8_t read_bit(void);
+    void depower(void);
+};
+
+#endif
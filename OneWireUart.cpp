@@ -0,0 +1,108 @@
+#include "OneWireUart.h"
+#include "application.h"
+
+OneWireUart::OneWireUart(USARTSerial &serial): serial(serial) {
+}
+
+void OneWireUart::begin() {
+    serial.begin(115200);
+    serial.halfduplex(true);
+}
+
+void OneWireUart::encode(uint8_t v, uint8_t frames[8]) {
+    for (uint8_t i = 0; i < 8; i++) {
+        frames[i] = (v & (1 << i)) ? 0xFF : 0x00;
+    }
+}
+
+// A device pulling a read slot low flips at least one of the low data
+// bits of the echo, so anything but 0xFF reads as a 0.
+uint8_t OneWireUart::decode(const uint8_t frames[8]) {
+    uint8_t v = 0;
+
+    for (uint8_t i = 0; i < 8; i++) {
+        if (frames[i] == 0xFF) v |= (1 << i);
+    }
+    return v;
+}
+
+//
+// Send `count` frames and replace them with what came back on the line.
+// Returns false if the echo didn't arrive, which means the bus or the
+// wiring is broken.
+//
+bool OneWireUart::transfer(uint8_t *frames, uint8_t count) {
+    unsigned long start;
+
+    while (serial.available()) serial.read(); // drop any stale echo
+
+    for (uint8_t i = 0; i < count; i++) serial.write(frames[i]);
+
+    start = micros();
+    for (uint8_t i = 0; i < count; i++) {
+        while (!serial.available()) {
+            if (micros() - start > ONEWIRE_UART_TIMEOUT_US * count) return false;
+        }
+        frames[i] = serial.read();
+    }
+    return true;
+}
+
+//
+// Reset at 9600 baud: anything but an unchanged 0xF0 echo means a device
+// answered with a presence pulse.
+//
+uint8_t OneWireUart::reset(void) {
+    uint8_t frame = 0xF0;
+    bool echoed;
+
+    serial.flush();
+    serial.begin(9600);
+    serial.halfduplex(true);
+
+    echoed = transfer(&frame, 1);
+
+    serial.begin(115200);
+    serial.halfduplex(true);
+
+    return echoed && frame != 0xF0;
+}
+
+void OneWireUart::write_bit(uint8_t v) {
+    uint8_t frame = (v & 1) ? 0xFF : 0x00;
+
+    transfer(&frame, 1);
+}
+
+uint8_t OneWireUart::read_bit(void) {
+    uint8_t frame = 0xFF;
+
+    if (!transfer(&frame, 1)) return 1; // an idle bus reads as ones
+
+    return frame == 0xFF;
+}
+
+void OneWireUart::write(uint8_t v, uint8_t /* power */) {
+    uint8_t frames[8];
+
+    encode(v, frames);
+    transfer(frames, 8);
+}
+
+void OneWireUart::write_bytes(const uint8_t *buf, uint16_t count, bool /* power */) {
+    for (uint16_t i = 0 ; i < count ; i++)
+        write(buf[i]);
+}
+
+uint8_t OneWireUart::read(void) {
+    uint8_t frames[8];
+
+    encode(0xFF, frames);
+    if (!transfer(frames, 8)) return 0xFF;
+
+    return decode(frames);
+}
+
+// The UART releases the line between frames, there's nothing to undo
+void OneWireUart::depower(void) {
+}
@@ -0,0 +1,59 @@
+#ifndef OneWireUart_h
+#define OneWireUart_h
+
+#include "OneWire.h"
+
+// How long to wait for a slot to echo back before giving up on the bus
+#define ONEWIRE_UART_TIMEOUT_US 2000
+
+// OneWire bus driven by a hardware UART instead of bit-banged GPIO. The
+// UART's TX and RX are tied together in half duplex, open drain mode and
+// every slot is one UART frame:
+//
+//   reset: 0xF0 at 9600 baud. The start bit plus four zero bits hold the
+//          bus low for ~520us; a presence pulse corrupts the echo.
+//   write: 0xFF (a ~9us low start bit) for a 1, 0x00 (~78us low) for a 0,
+//          at 115200 baud.
+//   read:  0xFF at 115200 baud, the bit is 1 if it echoes back unchanged.
+//
+// All of the slot timing is done by the UART, so there are no
+// noInterrupts() windows and no delayMicroseconds() for WiFi activity to
+// disturb. A byte is sent as eight frames in one go and its echo decoded
+// at the end, so most of the byte time is spent in the UART driver.
+//
+// The line can't be actively held high, so parasite powered devices need
+// an external strong pullup; the `power` flags are ignored.
+class OneWireUart : public OneWire
+{
+  private:
+    USARTSerial & serial;
+
+    bool transfer(uint8_t *frames, uint8_t count);
+
+  protected:
+    // Overdrive slots would need the UART near 1Mbaud, which isn't
+    // supported here, so the bus stays at standard speed
+    bool can_overdrive(void) { return false; }
+
+  public:
+    // The UART owns TX and RX, no GPIO is touched, so nothing changes on
+    // the pins until begin()
+    OneWireUart(USARTSerial &serial);
+
+    // Call once from setup()
+    void begin();
+
+    uint8_t reset(void);
+    void write(uint8_t v, uint8_t power = 0);
+    void write_bytes(const uint8_t *buf, uint16_t count, bool power = 0);
+    uint8_t read(void);
+    void write_bit(uint8_t v);
+    uint8_t read_bit(void);
+    void depower(void);
+
+    // Slot encoding, one UART frame per bit, least significant bit first
+    static void encode(uint8_t v, uint8_t frames[8]);
+    static uint8_t decode(const uint8_t frames[8]);
+};
+
+#endif
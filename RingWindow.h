@@ -0,0 +1,79 @@
+#ifndef RING_WINDOW_H_
+#define RING_WINDOW_H_
+
+#include <limits>
+#include <stdint.h>
+
+// Fixed capacity sliding window over the last N samples, stored inline.
+// Slots start out as EMPTY, the lowest value T can hold (RAW_TEMP_INVALID
+// for RawTemp), and only the other samples count towards the mean. The
+// total is kept as a running Sum so push() and total() are O(1); it's
+// recomputed from the slots each time the window wraps so float rounding
+// can't build up when Sum is a float.
+template<typename T, uint8_t N, typename Sum = T>
+class RingWindow {
+  static_assert(N > 0, "RingWindow needs at least one slot");
+
+  T items[N];
+  Sum sum = Sum();
+  uint8_t next = 0;
+  uint8_t valid = 0;
+
+  public:
+    static constexpr T EMPTY = std::numeric_limits<T>::lowest();
+
+    RingWindow() {
+      for (uint8_t i = 0; i < N; i++) items[i] = EMPTY;
+    }
+
+    // Adds a sample, dropping the oldest
+    void push(const T& item) {
+      T &slot = items[next];
+
+      if (slot != EMPTY) {
+        sum -= slot;
+        valid--;
+      }
+      slot = item;
+      if (item != EMPTY) {
+        sum += item;
+        valid++;
+      }
+
+      if (++next == N) {
+        next = 0;
+        sum = Sum();
+        for (uint8_t i = 0; i < N; i++) {
+          if (items[i] != EMPTY) sum += items[i];
+        }
+      }
+    }
+
+    // The running total, see count()
+    Sum total() const {
+      return sum;
+    }
+
+    uint8_t count() const {
+      return valid;
+    }
+
+    static constexpr uint8_t capacity() {
+      return N;
+    }
+
+    // All N slots, in no particular order
+    const T* data() const {
+      return items;
+    }
+
+    // Oldest first, i = 0 .. N - 1
+    const T& operator[](uint8_t i) const {
+      return items[(next + i) % N];
+    }
+};
+
+template<typename T, uint8_t N, typename Sum>
+constexpr T RingWindow<T, N, Sum>::EMPTY;
+
+#endif // RING_WINDOW_H_
@@ -0,0 +1,153 @@
+#ifndef ROLLUPS_H_
+#define ROLLUPS_H_
+
+#include "FixedTemp.h"
+#include <stdint.h>
+
+// Closed buckets Sensors keeps for the reading across every sensor: the
+// last 5 minutes, the last hour in 5 minute steps and the last day hourly.
+// 16 bytes a bucket.
+#define ROLLUP_MINUTES 5
+#define ROLLUP_FIVE_MINUTES 12
+#define ROLLUP_HOURS 24
+
+// Closed buckets each sensor keeps per level
+#ifndef SENSOR_ROLLUP_DEPTH
+#define SENSOR_ROLLUP_DEPTH 1
+#endif
+
+enum RollupLevel {
+  ROLLUP_1M,
+  ROLLUP_5M,
+  ROLLUP_1H,
+  ROLLUP_LEVELS
+};
+
+// Min, max, mean and count of the samples in one period
+struct RollupBucket {
+  uint32_t start = 0; // seconds
+  int32_t sum = 0;
+  uint16_t count = 0;
+  RawTemp min = INT16_MAX;
+  RawTemp max = INT16_MIN;
+
+  void add(RawTemp sample) {
+    sum += sample;
+    count++;
+    if (sample < min) min = sample;
+    if (sample > max) max = sample;
+  }
+
+  void merge(const RollupBucket &other) {
+    sum += other.sum;
+    count += other.count;
+    if (other.min < min) min = other.min;
+    if (other.max > max) max = other.max;
+  }
+
+  RawTemp mean() const {
+    return count == 0 ? RAW_TEMP_INVALID : divRound(sum, count);
+  }
+};
+
+// The last N closed buckets of one level
+template<uint8_t N>
+class RollupRing {
+  static_assert(N > 0, "RollupRing needs at least one bucket");
+
+  RollupBucket buckets[N];
+  uint8_t next = 0;
+  uint8_t filled = 0;
+
+  public:
+    void push(const RollupBucket &bucket) {
+      buckets[next] = bucket;
+      if (++next == N) next = 0;
+      if (filled < N) filled++;
+    }
+
+    uint8_t count() const {
+      return filled;
+    }
+
+    // Oldest first, i = 0 .. count() - 1
+    const RollupBucket& operator[](uint8_t i) const {
+      return buckets[(next + N - filled + i) % N];
+    }
+};
+
+// Rolls samples up into 1 minute, 5 minute and 1 hour buckets. Samples
+// only go into the open minute; a bucket that closes is merged into the
+// open bucket of the level above, so each sample costs O(1) however long
+// the periods are. Buckets close on the first sample or settle() after
+// their period, and periods with no samples leave no bucket.
+template<uint8_t MINUTES, uint8_t FIVE_MINUTES, uint8_t HOURS>
+class Rollups {
+  RollupBucket open[ROLLUP_LEVELS];
+  RollupRing<MINUTES> minutes;
+  RollupRing<FIVE_MINUTES> fiveMinutes;
+  RollupRing<HOURS> hours;
+
+  static uint32_t period(uint8_t level) {
+    return level == ROLLUP_1M ? 60 : level == ROLLUP_5M ? 300 : 3600;
+  }
+
+  void close(uint8_t level) {
+    RollupBucket &bucket = open[level];
+    uint8_t up = level + 1;
+
+    switch (level) {
+    case ROLLUP_1M: minutes.push(bucket); break;
+    case ROLLUP_5M: fiveMinutes.push(bucket); break;
+    default: hours.push(bucket); break;
+    }
+
+    if (up < ROLLUP_LEVELS) {
+      uint32_t start = bucket.start - bucket.start % period(up);
+
+      if (open[up].count > 0 && open[up].start != start) close(up);
+      open[up].start = start;
+      open[up].merge(bucket);
+    }
+    bucket = RollupBucket();
+  }
+
+  public:
+    // `now` in seconds
+    void add(RawTemp sample, uint32_t now) {
+      settle(now);
+      if (open[ROLLUP_1M].count == 0) open[ROLLUP_1M].start = now - now % period(ROLLUP_1M);
+      open[ROLLUP_1M].add(sample);
+    }
+
+    // Closes the open buckets whose period is over. Lower levels go
+    // first so their last bucket makes it into the level above.
+    void settle(uint32_t now) {
+      for (uint8_t level = 0; level < ROLLUP_LEVELS; level++) {
+        if (open[level].count > 0 && now - open[level].start >= period(level)) close(level);
+      }
+    }
+
+    // The most recent closed bucket, or null before the first one closes
+    const RollupBucket *latest(RollupLevel level) const {
+      switch (level) {
+      case ROLLUP_1M: return minutes.count() ? &minutes[minutes.count() - 1] : NULL;
+      case ROLLUP_5M: return fiveMinutes.count() ? &fiveMinutes[fiveMinutes.count() - 1] : NULL;
+      default: return hours.count() ? &hours[hours.count() - 1] : NULL;
+      }
+    }
+
+    const RollupRing<MINUTES>& minuteBuckets() const {
+      return minutes;
+    }
+
+    const RollupRing<FIVE_MINUTES>& fiveMinuteBuckets() const {
+      return fiveMinutes;
+    }
+
+    const RollupRing<HOURS>& hourBuckets() const {
+      return hours;
+    }
+};
+
+#endif // ROLLUPS_H_
@@ -0,0 +1,153 @@
+#ifndef SAMPLE_FILTER_H_
+#define SAMPLE_FILTER_H_
+
+#include "FixedTemp.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+// Samples the median and Hampel filters look back over, 5 or 7
+#ifndef FILTER_SIZE
+#define FILTER_SIZE 5
+#endif
+
+// The EWMA weighs each new sample by 1 / 2^EWMA_SHIFT
+#define EWMA_SHIFT 2
+#define EWMA_FRACTION_BITS 8 // kept below the 1/16 C to stop rounding creep
+
+// A Hampel filter replaces samples further than ~3 scaled median absolute
+// deviations (3 * 1.4826, taken as 9/2) from the median. The MAD is floored
+// at HAMPEL_MIN_MAD, in 1/16 C, so a flat signal doesn't turn every 1/16 C
+// step into an outlier.
+#define HAMPEL_THRESHOLD_NUM 9
+#define HAMPEL_THRESHOLD_DEN 2
+#define HAMPEL_MIN_MAD 2
+
+enum FilterMode {
+  FILTER_NONE,   // samples go into the window as they are
+  FILTER_MEDIAN, // median of the last FILTER_SIZE samples
+  FILTER_EWMA,   // exponentially weighted moving average
+  FILTER_HAMPEL  // outliers swapped for the median, the rest untouched
+};
+
+// Orders a pair without a branch
+inline void exchange(RawTemp &a, RawTemp &b) {
+  RawTemp low = a < b ? a : b;
+
+  b = a ^ b ^ low;
+  a = low;
+}
+
+// Sorts `values` in place and returns the middle one. Sorting networks,
+// written out so the values stay in registers: 9 exchanges sort 5 values,
+// 16 sort 7, with no data dependent branches.
+template<uint8_t N> RawTemp medianOf(RawTemp values[N]);
+
+template<> inline RawTemp medianOf<5>(RawTemp v[5]) {
+  exchange(v[0], v[3]); exchange(v[1], v[4]);
+  exchange(v[0], v[2]); exchange(v[1], v[3]);
+  exchange(v[0], v[1]); exchange(v[2], v[4]);
+  exchange(v[1], v[2]); exchange(v[3], v[4]);
+  exchange(v[2], v[3]);
+  return v[2];
+}
+
+template<> inline RawTemp medianOf<7>(RawTemp v[7]) {
+  exchange(v[0], v[6]); exchange(v[2], v[3]); exchange(v[4], v[5]);
+  exchange(v[0], v[2]); exchange(v[1], v[4]); exchange(v[3], v[6]);
+  exchange(v[0], v[1]); exchange(v[2], v[5]); exchange(v[3], v[4]);
+  exchange(v[1], v[2]); exchange(v[4], v[6]);
+  exchange(v[2], v[3]); exchange(v[4], v[5]);
+  exchange(v[1], v[2]); exchange(v[3], v[4]); exchange(v[5], v[6]);
+  return v[3];
+}
+
+// Median of the first `count` values, for while the history fills up.
+// Insertion sort, count is below FILTER_SIZE.
+inline RawTemp partialMedian(RawTemp values[], uint8_t count) {
+  for (uint8_t i = 1; i < count; i++) {
+    RawTemp value = values[i];
+    uint8_t j = i;
+
+    for (; j > 0 && values[j - 1] > value; j--) values[j] = values[j - 1];
+    values[j] = value;
+  }
+  return values[count / 2];
+}
+
+// The stage each sample passes through on its way into a sensor's window.
+// Constant memory: FILTER_SIZE samples of history and the EWMA state.
+class SampleFilter {
+  static_assert(FILTER_SIZE == 5 || FILTER_SIZE == 7, "FILTER_SIZE must be 5 or 7");
+
+  FilterMode filterMode = FILTER_HAMPEL;
+  RawTemp history[FILTER_SIZE];
+  uint8_t next = 0;
+  uint8_t count = 0;
+  int32_t ewma = 0; // 1/16 C << EWMA_FRACTION_BITS
+
+  // Median of the history, with `sorted` left holding it in order
+  RawTemp median(RawTemp sorted[FILTER_SIZE]) const {
+    if (count < FILTER_SIZE) {
+      for (uint8_t i = 0; i < count; i++) sorted[i] = history[i];
+      return partialMedian(sorted, count);
+    }
+
+    for (uint8_t i = 0; i < FILTER_SIZE; i++) sorted[i] = history[i];
+    return medianOf<FILTER_SIZE>(sorted);
+  }
+
+  RawTemp hampel(RawTemp sample) const {
+    RawTemp sorted[FILTER_SIZE];
+    RawTemp center = median(sorted);
+    int32_t mad;
+
+    // the deviations from the median, in place
+    if (count < FILTER_SIZE) {
+      for (uint8_t i = 0; i < count; i++) sorted[i] = abs(sorted[i] - center);
+      mad = partialMedian(sorted, count);
+    } else {
+      for (uint8_t i = 0; i < FILTER_SIZE; i++) sorted[i] = abs(sorted[i] - center);
+      mad = medianOf<FILTER_SIZE>(sorted);
+    }
+    if (mad < HAMPEL_MIN_MAD) mad = HAMPEL_MIN_MAD;
+
+    if (abs(sample - center) * HAMPEL_THRESHOLD_DEN > HAMPEL_THRESHOLD_NUM * mad) return center;
+    return sample;
+  }
+
+  public:
+    FilterMode mode() const {
+      return filterMode;
+    }
+
+    void setMode(FilterMode mode) {
+      filterMode = mode;
+      next = 0;
+      count = 0;
+    }
+
+    // Takes a sample and returns what goes into the window in its place
+    RawTemp update(RawTemp sample) {
+      RawTemp sorted[FILTER_SIZE];
+
+      if (filterMode == FILTER_EWMA) {
+        int32_t scaled = static_cast<int32_t>(sample) * (1L << EWMA_FRACTION_BITS);
+
+        ewma = count == 0 ? scaled : ewma + ((scaled - ewma) >> EWMA_SHIFT);
+        count = 1;
+        return divRound(ewma, 1L << EWMA_FRACTION_BITS);
+      }
+
+      history[next] = sample;
+      if (++next == FILTER_SIZE) next = 0;
+      if (count < FILTER_SIZE) count++;
+
+      switch (filterMode) {
+      case FILTER_MEDIAN: return median(sorted);
+      case FILTER_HAMPEL: return hampel(sample);
+      default: return sample;
+      }
+    }
+};
+
+#endif // SAMPLE_FILTER_H_
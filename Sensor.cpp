@@ -1,107 +1,337 @@
 #include "OneWire.h"
 #include "Sensor.h"
-#include "AverageTemps.h"
 
 bool compareSensorAddresses(const byte lhs[SENSOR_ADDR_SIZE], const byte rhs[SENSOR_ADDR_SIZE]) {
-  Serial.print("Comparing: ");
-  for (int i = 0; i < SENSOR_ADDR_SIZE; i++) {
-    Serial.print(lhs[i], HEX);
-    Serial.print(" ");
+  return romKey(lhs) == romKey(rhs);
+}
+
+void Sensor::read() {
+  unsigned long started;
+
+  ds->reset();
+  ds->select(addr);
+  // Start conversion. A parasite powered sensor needs power on at the end
+  // and can't answer until it's done, an externally powered one holds read
+  // slots low while it's converting.
+  ds->write(0x44, parasite ? 1 : 0);
+  started = millis();
+  if (parasite) {
+    delay(conversionTime());
+  } else {
+    while (!ds->read_bit() && millis() - started < conversionTime());
   }
-  Serial.print("  VS  ");
-  for (int i = 0; i < SENSOR_ADDR_SIZE; i++) {
-    Serial.print(rhs[i], HEX);
-    Serial.print(" ");
+  // we might do a ds.depower() here, but the reset will take care of it.
+
+  readScratchpad();
+}
+
+// Read Power Supply. A parasite powered sensor pulls the read slot low.
+bool Sensor::readPowerSupply() {
+  if (!ds->reset()) return false;
+
+  ds->select(addr);
+  ds->write(0xB4);
+  parasite = !ds->read_bit();
+  return true;
+}
+
+// Reads back the result of a conversion that has already finished, either
+// one started by read() or a bus wide Convert T issued by Sensors::read().
+ReadResult Sensor::readScratchpad() {
+  Scratchpad scratchpad;
+  ReadResult result;
+  bool valid;
+
+  if (!recallScratchpad() || !selectForRead()) {
+    presenceFailures++;
+    return READ_NO_PRESENCE;
   }
-  Serial.println();
 
-  bool eql = true;
-  for (int i = 0; eql != false && i < SENSOR_ADDR_SIZE; i++) {
-    if (lhs[i] != rhs[i]) {
-      eql = false;
-    }
+  valid = family->read(*ds, scratchpad);
+  ds->set_overdrive(false);
+
+  result = checkScratchpad(valid, scratchpad);
+  if (result == READ_CRC_ERROR && overdrive) {
+    // Retries and later reads go at standard speed
+    overdrive = false;
+    Serial.println("Overdrive read failed, back to standard speed");
   }
-  return eql;
-}
-
-float parseTempValue(byte data[12], byte type_s) {
-  float celsius;
-
-  int16_t raw = (data[1] << 8) | data[0];
-  if (type_s) {
-    if (type_s == 1) { // DS18S20
-      raw = raw << 3; // 9 bit resolution default
-      if (data[7] == 0x10) {
-        // "count remain" gives full 12 bit resolution
-        raw = (raw & 0xFFF0) + 12 - data[6];
-      }
-      celsius = static_cast<float>(raw) / 16.0;
-    } else { // type_s==2 for DS2438
-      if (data[2] > 127) data[2]=0;
-      data[1] = data[1] >> 3;
-      celsius = static_cast<float>(data[2]) + (static_cast<float>(data[1]) * .03125);
-    }
-  } else { // DS18B20 and DS1822
-    byte cfg = (data[4] & 0x60);
-    // at lower res, the low bits are undefined, so let's zero them
-    if (cfg == 0x00) raw = raw & ~7;      // 9 bit resolution, 93.75 ms
-    else if (cfg == 0x20) raw = raw & ~3; // 10 bit res, 187.5 ms
-    else if (cfg == 0x40) raw = raw & ~1; // 11 bit res, 375 ms
-    // default is 12 bit resolution, 750 ms conversion time
-    celsius = static_cast<float>(raw) / 16.0;
+  return result;
+}
+
+#if ONEWIRE_ASYNC
+// The same read queued on the timer driven bus, which runs it in the
+// background at standard speed whatever `overdrive` says. It takes 33 of
+// the queue's slots at most, recall included, so it always fits on an idle
+// bus. Collect it with collectScratchpad() once the bus is idle again.
+void Sensor::queueScratchpad(OneWireAsync &bus) {
+  byte command[SCRATCHPAD_COMMAND_SIZE];
+  byte length = family->recall(command);
+
+  if (length) {
+    bus.queueReset();
+    bus.queueSelect(addr);
+    bus.queueWriteBytes(command, length);
   }
-  return celsius;
+  bus.queueReset();
+  bus.queueSelect(addr);
+  bus.queueWriteBytes(command, family->command(command));
+  bus.queueRead(family->scratchpadLength);
 }
 
-bool readData(byte data[12], OneWire & ds) {
-  byte i;
-  bool success = false;
+ReadResult Sensor::collectScratchpad(OneWireAsync &bus) {
+  Scratchpad scratchpad;
+  byte command[SCRATCHPAD_COMMAND_SIZE];
+  byte recalled = 1;
+  byte presence = 0;
 
-  for ( i = 0; i < 9; i++ ) { // we need 9 bytes
-    data[i] = ds.read();
+  if (family->recall(command)) bus.result(recalled);
+  bus.result(presence);
+  for (byte i = 0; i < family->scratchpadLength; i++) {
+    bus.result(scratchpad.data[i]);
   }
+  return readScratchpad(recalled && presence, scratchpad);
+}
+#endif
 
-  if (0xff == data[5] && 0x10 == data[7] && (OneWire::crc8(data, 8) == data[8])) {
-    success = true;
+// The outcome of a read the caller ran on the wire itself, queued or on
+// several buses at once: whether the reset saw a presence pulse, and the
+// bytes that came back.
+ReadResult Sensor::readScratchpad(bool present, Scratchpad &scratchpad) {
+  if (!present) {
+    presenceFailures++;
+    return READ_NO_PRESENCE;
   }
-  return success;
+  return checkScratchpad(family->decode(scratchpad), scratchpad);
 }
 
+ReadResult Sensor::checkScratchpad(bool valid, const Scratchpad &scratchpad) {
+  if (!valid) {
+    crcErrors++;
+    Serial.println("Invalid Data CRC");
+    // debugPublish("Invalid Data CRC");
+    return READ_CRC_ERROR;
+  }
 
-void Sensor::read() {
-  byte data[12];
-  float celsius, fahrenheit;
+  resolution = scratchpad.resolution;
 
-  ds.select(addr);
-  ds.write(0x44); // start conversion, with parasite power on at the end
-  delay(900); // maybe 750ms is enough, maybe not
-  // we might do a ds.depower() here, but the reset will take care of it.
+  if (scratchpad.raw < RAW_TEMP_MIN || scratchpad.raw > RAW_TEMP_MAX) {
+    rangeErrors++;
+    Serial.print("Invalid Temperature, 1/16 C: ");
+    Serial.println(scratchpad.raw);
+    return READ_OUT_OF_RANGE;
+  }
 
-  ds.reset();
-  ds.select(addr);
-  ds.write(0xBE, 0); // Read Scratchpad
-
-  if (readData(data, ds)) {
-    celsius = parseTempValue(data, type);
-    fahrenheit = celsius * 1.8 + 32.0;
-
-    if (fahrenheit > -30.0F && fahrenheit < 120.0F) {
-      temp = fahrenheit;
-      temperatures.erase(temperatures.begin());
-      temperatures.push_back(fahrenheit);
-      minute_average = averageTemperatures();
-    } else {
-      Serial.print("Invalid Temperature: ");
-      Serial.println(fahrenheit);
-      // throw "Invalid Temperature";
-    }
-  } else {
-    Serial.println("Invalid Data CRC");
-    // debugPublish("Invalid Data CRC");
-    // throw "Invalid Data CRC";
+  temp = scratchpad.raw;
+  addTemperature(scratchpad.raw);
+  return READ_OK;
+}
+
+// Averages every `oversample` readings into one window sample, so several
+// fast low resolution conversions can stand in for one slow 12 bit one.
+// The sample then goes through the filter stage on its way into the window.
+// A change of pace is judged on the unfiltered sample, so an outlier the
+// filter hides still gets the sensor looked at more often.
+void Sensor::addTemperature(RawTemp raw) {
+  RawTemp sample;
+  RawTemp filtered;
+  bool changed;
+  uint32_t now;
+
+  oversampleTotal += raw;
+  if (++oversampleCount < oversample) return;
+
+  sample = divRound(oversampleTotal, oversampleCount);
+  changed = minute_average != RAW_TEMP_INVALID && abs(sample - minute_average) > SAMPLE_STEP;
+  filtered = filter.update(sample);
+  now = millis() / 1000;
+
+  temperatures.push(filtered);
+  rollups.add(filtered, now);
+  if (history != NULL) history->append(romKey(addr), historyChunk, now, filtered);
+  minute_average = averageTemperatures();
+  updateInterval(changed);
+
+  oversampleTotal = 0;
+  oversampleCount = 0;
+}
+
+// Writes the resolution into the config register, keeping the TH/TL alarm
+// bytes as they are. With `persist` the scratchpad is also copied to the
+// sensor's EEPROM so it survives a power cycle. Only the families with a
+// config register take it.
+bool Sensor::setResolution(byte bits, bool persist) {
+  Scratchpad scratchpad;
+
+  if (!family->configurable || bits < 9 || bits > 12) return false;
+  if (!readScratchpadData(scratchpad)) return false;
+
+  writeScratchpad(scratchpad.data[2], scratchpad.data[3], ((bits - 9) << 5) | 0x1F);
+  resolution = bits;
+
+  if (persist) {
+    ds->reset();
+    ds->select(addr);
+    ds->write(0x48, parasite ? 1 : 0); // Copy Scratchpad, parasite power on while it writes
+    delay(10);
+    ds->depower();
+  }
+
+  return true;
+}
+
+// Programs the TH/TL alarm registers, in whole degrees C. After each
+// conversion the sensor flags itself for Alarm Search when the integer
+// part of the temperature is <= low or >= high. The DS2438 has no alarm.
+bool Sensor::setAlarm(int8_t high, int8_t low) {
+  Scratchpad scratchpad;
+
+  if (!family->alarm) return false;
+  if (!readScratchpadData(scratchpad)) return false;
+
+  writeScratchpad(high, low, scratchpad.data[4]);
+  alarmArmed = true;
+
+  return true;
+}
+
+// Switching filters starts the new one from an empty history, the window
+// keeps the samples it already has.
+void Sensor::setFilter(FilterMode mode) {
+  filter.setMode(mode);
+}
+
+// Whether the sensor should sit this acquisition cycle out. Once the
+// quarantine runs out the sensor gets one read to prove itself.
+bool Sensor::inQuarantine(uint32_t now) {
+  if (quarantined && static_cast<int32_t>(now - quarantineUntil) >= 0) {
+    quarantined = false;
+  }
+  return quarantined;
+}
+
+// Doubles the read interval while the window is full and steady
+void Sensor::updateInterval(bool changed) {
+  bool steady = !changed &&
+    temperatures.count() == TEMPERATURE_WINDOW &&
+    windowStats().stddev16() <= SAMPLE_STEADY_STDDEV;
+
+  if (!steady) {
+    interval = 1;
+  } else if (interval < SAMPLE_INTERVAL_MAX) {
+    interval *= 2;
+  }
+}
+
+// Whether the sensor sits a cycle out is settled here, once, so its
+// conversion and its read agree even if the quarantine runs out between
+// the two.
+void Sensor::startCycle(uint32_t now) {
+  inQuarantine(now);
+  if (cyclesSinceRead < 255) cyclesSinceRead++;
+  due = !quarantined && cyclesSinceRead >= interval;
+}
+
+void Sensor::readSucceeded() {
+  failures = 0;
+  cyclesSinceRead = 0;
+}
+
+// Failed sensors are tried again every cycle, quarantine does the backing off.
+// Readings already taken towards an oversampled sample are dropped, they'd
+// be averaged with ones taken a cycle or a quarantine later.
+void Sensor::readFailed(uint32_t now) {
+  uint32_t backoff = QUARANTINE_MIN_MS;
+
+  interval = 1;
+  oversampleTotal = 0;
+  oversampleCount = 0;
+
+  if (failures < 255) failures++;
+  if (failures < QUARANTINE_AFTER) return;
+
+  for (byte i = QUARANTINE_AFTER; i < failures && backoff < QUARANTINE_MAX_MS; i++) {
+    backoff *= 2;
   }
+  if (backoff > QUARANTINE_MAX_MS) backoff = QUARANTINE_MAX_MS;
+
+  quarantined = true;
+  quarantineUntil = now + backoff;
+  quarantines++;
+
+  Serial.print("Sensor quarantined for ");
+  Serial.print(backoff / 1000);
+  Serial.println("s");
 }
 
-float Sensor::averageTemperatures() {
-  return averageGreaterThanZero(begin(temperatures), end(temperatures));
+// Resets the bus and addresses the sensor, at overdrive speed if it takes
+// it. Overdrive Match ROM leaves the master at overdrive, so the caller
+// has to put the bus back to standard speed once it's done.
+// Has the sensor load its scratchpad, for the families that need telling.
+// False if it didn't answer the reset.
+bool Sensor::recallScratchpad() {
+  byte command[SCRATCHPAD_COMMAND_SIZE];
+  byte length = family->recall(command);
+
+  if (length == 0) return true;
+  if (!selectForRead()) return false;
+
+  ds->write_bytes(command, length);
+  return true;
+}
+
+bool Sensor::selectForRead() {
+  if (overdrive) return ds->overdrive_select(addr);
+
+  if (!ds->reset()) return false;
+  ds->select(addr);
+  return true;
+}
+
+// Tries Overdrive Match ROM and a scratchpad read at overdrive speed, and
+// only keeps overdrive if the read comes back valid. A presence pulse
+// alone doesn't show the bus and the master's slots are fast enough for
+// data. Devices without overdrive ignore the rest of the exchange until
+// the standard speed reset at the end.
+bool Sensor::probeOverdrive() {
+  Scratchpad scratchpad;
+
+  overdrive = ds->overdrive_select(addr) && family->read(*ds, scratchpad);
+  ds->set_overdrive(false);
+  ds->reset();
+
+  return overdrive;
+}
+
+bool Sensor::readScratchpadData(Scratchpad &scratchpad) {
+  ds->reset();
+  ds->select(addr);
+
+  return family->read(*ds, scratchpad);
+}
+
+// The DS18S20 only takes TH and TL, the configurable families also take
+// the config register.
+void Sensor::writeScratchpad(byte th, byte tl, byte cfg) {
+  ds->reset();
+  ds->select(addr);
+  ds->write(0x4E); // Write Scratchpad
+  ds->write(th);
+  ds->write(tl);
+  if (family->configurable) ds->write(cfg);
+}
+
+uint16_t Sensor::conversionTime() {
+  return family->conversionTime(resolution);
+}
+
+// Spread of the samples in the minute average
+Stats Sensor::windowStats() const {
+  return statsOf(temperatures.data(), TEMPERATURE_WINDOW);
+}
+
+RawTemp Sensor::averageTemperatures() {
+  if (temperatures.count() == 0) return RAW_TEMP_INVALID;
+
+  return divRound(temperatures.total(), temperatures.count());
 }
@@ -2,35 +2,125 @@
 #define SENSOR_H_
 
 #include "OneWire.h"
-#include <list>
+#include "OneWireAsync.h"
+#include "RingWindow.h"
+#include "AverageTemps.h"
+#include "ChipFamily.h"
+#include "SampleFilter.h"
+#include "Rollups.h"
+#include "SeriesStore.h"
 
 #define SENSOR_ADDR_SIZE 8
+#define TEMPERATURE_WINDOW 6 // samples in the minute average
+
+// A scratchpad read with a bad CRC is retried straight away, the scratchpad
+// still holds the conversion. A sensor that fails QUARANTINE_AFTER cycles in
+// a row is left out of acquisition for QUARANTINE_MIN_MS, doubling on each
+// further failure up to QUARANTINE_MAX_MS.
+#define READ_RETRIES 2
+#define QUARANTINE_AFTER 3
+#define QUARANTINE_MIN_MS 10000UL
+#define QUARANTINE_MAX_MS 640000UL
+
+// A sensor whose window holds steady is read every 2, 4 and then up to
+// SAMPLE_INTERVAL_MAX acquisition cycles. A sample more than SAMPLE_STEP
+// off the window average puts it straight back to every cycle.
+#define SAMPLE_INTERVAL_MAX 8
+#define SAMPLE_STEADY_STDDEV 32 // 1/256 C, so 1/8 C
+#define SAMPLE_STEP 2 // 1/16 C
+
+// The 64 bit ROM as a single integer, for comparing and hashing
+inline uint64_t romKey(const byte addr[SENSOR_ADDR_SIZE]) {
+  uint64_t key;
+
+  memcpy(&key, addr, sizeof(key));
+  return key;
+}
 
 bool compareSensorAddresses(const byte lhs[8], const byte rhs[8]);
 
+typedef Rollups<SENSOR_ROLLUP_DEPTH, SENSOR_ROLLUP_DEPTH, SENSOR_ROLLUP_DEPTH> SensorRollups;
+
+enum ReadResult {
+  READ_OK,
+  READ_NO_PRESENCE,
+  READ_CRC_ERROR,
+  READ_OUT_OF_RANGE
+};
+
 class Sensor {
-  OneWire & ds;
-  std::list<float> temperatures;
+  OneWire * ds;
+  SampleFilter filter;
+  RingWindow<RawTemp, TEMPERATURE_WINDOW, int32_t> temperatures;
+  int32_t oversampleTotal = 0;
+  byte oversampleCount = 0;
 
-  float averageTemperatures();
+  RawTemp averageTemperatures();
+  void addTemperature(RawTemp raw);
+  void updateInterval(bool changed);
+  bool readScratchpadData(Scratchpad &scratchpad);
+  void writeScratchpad(byte th, byte tl, byte cfg);
+  bool recallScratchpad();
+  bool selectForRead();
+  ReadResult checkScratchpad(bool valid, const Scratchpad &scratchpad);
 
   public:
     int id = 0;
     byte addr[SENSOR_ADDR_SIZE] = {0, 0, 0, 0, 0, 0, 0, 0};
-    byte type = '\0';
-    float temp;
-    float minute_average;
+    const ChipFamily *family = NULL; // set from the ROM when the sensor is found
+    byte bus = 0; // index of the bus in Sensors
+    byte resolution = 12; // assume the slowest until the config byte is read
+    byte oversample = 1; // conversions averaged into each window sample
+    bool alarmArmed = false; // TH/TL hold the control band
+    bool alarmed = false; // answered the last alarm search
+    bool pending = false; // still to be read this acquisition cycle
+    bool parasite = true; // assume the worst until Read Power Supply says
+    bool overdrive = false; // scratchpad reads at overdrive speed
+    byte retriesLeft = 0; // scratchpad retries left this acquisition cycle
+    byte failures = 0; // acquisition cycles failed in a row
+    bool quarantined = false; // sits this acquisition cycle out, see startCycle()
+    uint32_t quarantineUntil = 0; // millis()
+    byte interval = 1; // acquisition cycles between reads
+    byte cyclesSinceRead = 0;
+    bool due = true; // interval is up this acquisition cycle
+    RawTemp temp = RAW_TEMP_INVALID;
+    RawTemp minute_average = RAW_TEMP_INVALID;
+    SensorRollups rollups; // the window samples in 1m, 5m and 1h buckets
+    SeriesStore *history = NULL; // where the window samples are kept, if anywhere
+    uint16_t historyChunk = SERIES_NO_CHUNK; // the chunk the last one went into
 
-    Sensor(OneWire &ds): ds(ds) {
-      std::list<float> temps(6);
-      temperatures = temps;
-    }
+    // Health counters, exported on /metrics
+    uint32_t presenceFailures = 0;
+    uint32_t crcErrors = 0;
+    uint32_t rangeErrors = 0;
+    uint32_t retries = 0;
+    uint32_t quarantines = 0;
+
+    Sensor(): ds(NULL) {}
+    Sensor(OneWire &ds): ds(&ds) {}
 
     bool operator==(const Sensor& rhs) {
       return compareSensorAddresses(addr, rhs.addr);
     }
 
     void read();
+    bool readPowerSupply();
+    bool probeOverdrive();
+    ReadResult readScratchpad();
+    ReadResult readScratchpad(bool present, Scratchpad &scratchpad);
+#if ONEWIRE_ASYNC
+    void queueScratchpad(OneWireAsync &bus);
+    ReadResult collectScratchpad(OneWireAsync &bus);
+#endif
+    Stats windowStats() const;
+    uint16_t conversionTime();
+    bool setResolution(byte bits, bool persist = false);
+    bool setAlarm(int8_t high, int8_t low);
+    void setFilter(FilterMode mode);
+    bool inQuarantine(uint32_t now);
+    void startCycle(uint32_t now);
+    void readSucceeded();
+    void readFailed(uint32_t now);
 };
 
 #endif // SENSOR_H_
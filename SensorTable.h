@@ -0,0 +1,121 @@
+#ifndef SENSOR_TABLE_H_
+#define SENSOR_TABLE_H_
+
+#include "Sensor.h"
+
+// Fixed capacity table of sensors keyed by their 64 bit ROM, with no heap
+// use. The sensors are kept packed at the front of an inline array, so
+// iterating is a walk over contiguous memory, and the ROM keys sit in a
+// column of their own so lookups only touch 8 bytes per sensor. A small
+// open addressing index (linear probing, never more than half full) finds
+// a sensor by key in O(1). Removing moves the last sensor into the gap, so
+// pointers into the table only stay valid until the next removal.
+template<uint16_t N>
+class SensorTable {
+  static_assert(N > 0 && N <= 16384, "SensorTable capacity must be 1 to 16384");
+
+  static constexpr uint16_t indexSize(uint32_t size = 1) {
+    return size >= 2 * N ? size : indexSize(size * 2);
+  }
+  static const uint16_t INDEX_SIZE = indexSize();
+  static const uint16_t INDEX_MASK = INDEX_SIZE - 1;
+
+  Sensor items[N];
+  uint64_t keys[N];
+  uint16_t index[INDEX_SIZE] = {}; // slot + 1, 0 when empty
+  uint16_t count = 0;
+
+  // Fibonacci hashing, the ROM's serial bytes are sequential more often
+  // than they're random
+  static uint16_t home(uint64_t key) {
+    return static_cast<uint16_t>((key * 0x9E3779B97F4A7C15ULL) >> 48) & INDEX_MASK;
+  }
+
+  // The index entry holding `key`, or the empty one it would go in
+  uint16_t probe(uint64_t key) const {
+    uint16_t i = home(key);
+
+    while (index[i] != 0 && keys[index[i] - 1] != key) i = (i + 1) & INDEX_MASK;
+    return i;
+  }
+
+  public:
+    Sensor* begin() { return items; }
+    Sensor* end() { return items + count; }
+    uint16_t size() const { return count; }
+    static constexpr uint16_t capacity() { return N; }
+
+    Sensor* find(uint64_t key) {
+      uint16_t i = probe(key);
+
+      return index[i] == 0 ? NULL : &items[index[i] - 1];
+    }
+
+    bool contains(uint64_t key) const {
+      return index[probe(key)] != 0;
+    }
+
+    // Adds the sensor under `key`, replacing any already there. Returns
+    // where it was stored, or NULL if the table is full.
+    Sensor* insert(uint64_t key, const Sensor &sensor) {
+      uint16_t i = probe(key);
+
+      if (index[i] == 0) {
+        if (count == N) return NULL;
+
+        keys[count] = key;
+        index[i] = ++count;
+      }
+      items[index[i] - 1] = sensor;
+      return &items[index[i] - 1];
+    }
+
+    bool remove(uint64_t key) {
+      uint16_t i = probe(key);
+      uint16_t slot, last, j;
+
+      if (index[i] == 0) return false;
+
+      slot = index[i] - 1;
+      last = count - 1;
+
+      // Backward shift deletion: pull later entries of the probe run into
+      // the hole, unless that would put them ahead of their home entry
+      index[i] = 0;
+      for (j = (i + 1) & INDEX_MASK; index[j] != 0; j = (j + 1) & INDEX_MASK) {
+        uint16_t h = home(keys[index[j] - 1]);
+
+        if (((j - h) & INDEX_MASK) >= ((j - i) & INDEX_MASK)) {
+          index[i] = index[j];
+          index[j] = 0;
+          i = j;
+        }
+      }
+
+      // Fill the gap in the packed array with the last sensor
+      if (slot != last) {
+        index[probe(keys[last])] = slot + 1;
+        items[slot] = items[last];
+        keys[slot] = keys[last];
+      }
+      count--;
+      return true;
+    }
+
+    // Removes every sensor `pred` returns true for. Walks backwards so the
+    // sensors moved into gaps have already been looked at.
+    template<typename Predicate>
+    uint16_t remove_if(Predicate pred) {
+      uint16_t removed = 0;
+
+      for (uint16_t slot = count; slot-- > 0;) {
+        if (slot < count && pred(items[slot])) {
+          remove(keys[slot]);
+          removed++;
+        }
+      }
+      return removed;
+    }
+};
+
+#endif // SENSOR_TABLE_H_
@@ -2,175 +2,737 @@
 #include "Sensor.h"
 #include "Sensors.h"
 #include "AverageTemps.h"
-#include <list>
+#include <inttypes.h>
+#include <math.h>
 
-const char* CHIP_NAME[] = { "DS18S20 or DS1822", "DS18S20", "DS2438", "Unknown" };
+bool findAndValidateDeviceAddress(uint8_t *addr, OneWire &ds) {
+  bool success = true;
 
-const char* getChipName(byte val) {
-  int index = static_cast<int>(val);
-  const char* chipName;
-  if ( index < 0 || index > 2 ) {
-    chipName = CHIP_NAME[3];
-  }  else {
-    chipName = CHIP_NAME[index];
+  if ( !ds.search(addr) ) {
+    Serial.println("No More Sensors Found");
+    ds.reset_search();
+    success = false;
+  } else if (OneWire::crc8(addr, 7) != addr[7]) {
+    Serial.println("Sensor CRC is not valid");
+    success = false;
   }
-  return chipName;
+  return success;
+}
+
+Sensors::Sensors(OneWire &ds) {
+  buses[0] = &ds;
+  busCount = 1;
+}
+
+#if ONEWIRE_ASYNC
+// Everything but the scratchpad reads goes through the blocking API, which
+// only ever runs while the queue is idle.
+Sensors::Sensors(OneWireAsync &ds): Sensors(static_cast<OneWire &>(ds)) {
+  async = &ds;
+}
+#endif
+
+#if ONEWIRE_PARALLEL
+// One bus a lane, up to MAX_BUSES of them
+Sensors::Sensors(OneWireParallel &lanes) {
+  while (busCount < MAX_BUSES && (lanes.lanes() & (1 << busCount))) {
+    buses[busCount] = &lanes.lane(busCount);
+    busCount++;
+  }
+  parallel = &lanes;
 }
+#endif
 
-byte chipType(byte a) {
-  byte type_s;
-  switch (a) {
-  case 0x10:
-    type_s = 1;
+Sensors::Sensors(OneWire *buses[], byte count) {
+  busCount = count > MAX_BUSES ? MAX_BUSES : count;
+  for (byte bus = 0; bus < busCount; bus++) {
+    this->buses[bus] = buses[bus];
+  }
+}
+
+// Latest and minute averaged readings across every sensor, in one pass
+void Sensors::aggregate() {
+  tempStats = Stats();
+  averageStats = Stats();
+
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    tempStats.add(it->temp);
+    averageStats.add(it->minute_average);
+  }
+  temp = tempStats.mean();
+  minute_average = averageStats.mean();
+  if (temp != RAW_TEMP_INVALID) rollups.add(temp, millis() / 1000);
+
+  if (nearControlBand()) {
+    for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+      it->interval = 1;
+    }
+  }
+}
+
+// Starts an acquisition cycle. Every sensor on every bus converts at once
+// so a cycle only waits one conversion period, no matter how many sensors
+// or buses are attached.
+//
+// Sensors are only read once their own interval is up, and quarantined
+// ones never are. A cycle with no sensor due and no alarm search to run is
+// skipped entirely, it leaves the bus alone and poll() doesn't report it.
+// Neither does a cycle that ended up reading nothing.
+void Sensors::start() {
+  bool anyDue = false;
+  uint32_t now = millis();
+
+  if (state != ACQUIRE_IDLE) return;
+
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    it->startCycle(now);
+    if (it->due) anyDue = true;
+  }
+
+  // Between full reads only the sensors that left the control band need
+  // to be read, and the alarm search tells us which ones those are. A cycle
+  // that (re)programs the alarms reads everything.
+  controlOnly = alarmWindowSet && !alarmsDirty && ++cyclesSinceFullRead < FULL_READ_EVERY;
+  if (!controlOnly) cyclesSinceFullRead = 0;
+
+  if (!anyDue && !controlOnly && !alarmsDirty) {
+    skippedCycles++;
+    return;
+  }
+
+  if (alarmsDirty) programAlarms();
+
+  pass = 0;
+  anyRead = false;
+  startConversion();
+}
+
+void Sensors::startConversion() {
+  for (byte bus = 0; bus < busCount; bus++) {
+    BusConversion &conversion = conversions[bus];
+
+    conversion.next = 0;
+    if (conversion.serial) {
+      conversion.done = !startSerialConversion(bus);
+      continue;
+    }
+
+    // The bus is only done converting once its slowest sensor is
+    conversion.time = 0;
+    for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+      if (it->id == 0 || it->bus != bus) continue;
+
+      if (it->conversionTime() > conversion.time) {
+        conversion.time = it->conversionTime();
+      }
+    }
+
+    resetBus(bus);
+    buses[bus]->skip();
+    // Parasite powered sensors need the strong pullup held through the
+    // conversion, otherwise leave the bus free to poll the ready bit.
+    conversion.pullup = conversion.parasite;
+    buses[bus]->write(0x44, conversion.pullup ? 1 : 0);
+    conversion.started = millis();
+    conversion.done = false;
+  }
+  conversionTimeElapsed = 0;
+  state = ACQUIRE_CONVERTING;
+}
+
+// Starts the next sensor on a bus that converts one sensor at a time.
+// Returns false once every sensor on the bus has had its turn.
+bool Sensors::startSerialConversion(byte bus) {
+  BusConversion &conversion = conversions[bus];
+  Sensor* sensor;
+
+  while ((sensor = busSensor(bus, conversion.next++)) != NULL) {
+    if (sensor->id == 0 || sensor->quarantined) continue;
+    // the alarm search needs every sensor to have converted
+    if (!sensor->due && !controlOnly) continue;
+
+    resetBus(bus);
+    buses[bus]->select(sensor->addr);
+    conversion.pullup = sensor->parasite;
+    buses[bus]->write(0x44, conversion.pullup ? 1 : 0);
+    conversion.time = sensor->conversionTime();
+    conversion.started = millis();
+    return true;
+  }
+  return false;
+}
+
+// Advances the acquisition cycle by at most one bus transaction and never
+// waits. Returns true once per cycle, when fresh averages are available.
+bool Sensors::poll() {
+  Sensor* sensor;
+
+  switch (state) {
+  case ACQUIRE_IDLE:
     break;
-  case 0x28:
-    type_s = 0;
+  case ACQUIRE_CONVERTING:
+    if (!conversionDone()) break;
+
+    conversionWait.observe(conversionTimeElapsed * 1000UL);
+
+    if (controlOnly) {
+      for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+        it->alarmed = false;
+      }
+      for (byte bus = 0; bus < busCount; bus++) {
+        buses[bus]->reset_search();
+      }
+      alarmBus = 0;
+      state = ACQUIRE_ALARM_SEARCH;
+    } else {
+      startReading();
+    }
     break;
-  case 0x22:
-    type_s = 0;
+  case ACQUIRE_ALARM_SEARCH:
+    if (!alarmSearch()) startReading();
     break;
-  case 0x26:
-    type_s = 2;
+  case ACQUIRE_READING:
+    sensor = nextRead();
+    if (sensor != NULL) {
+      if (readNext(*sensor)) sensor->pending = false;
+    } else if (++pass < oversample) {
+      startConversion();
+    } else if (anyRead) {
+      aggregate();
+      state = ACQUIRE_PUBLISHING;
+    } else {
+      state = ACQUIRE_IDLE;
+    }
     break;
+  case ACQUIRE_PUBLISHING:
+    state = ACQUIRE_IDLE;
+    return true;
   }
-  return type_s;
+  return false;
 }
 
-bool findAndValidateDeviceAddress(uint8_t *addr, OneWire &ds) {
-  bool success = true;
+bool Sensors::conversionDone() {
+  bool done = true;
 
-  if ( !ds.search(addr) ) {
-    Serial.println("No More Sensors Found");
-    ds.reset_search();
-    delay(250);
-    success = false;
-  } else if (OneWire::crc8(addr, 7) != addr[7]) {
-    Serial.println("Sensor CRC is not valid");
-    success = false;
+  for (byte bus = 0; bus < busCount; bus++) {
+    if (!busConversionDone(bus)) done = false;
   }
-  return success;
+  return done;
+}
+
+// Externally powered sensors hold read slots low until they finish
+// converting, so the bus can move on as soon as they release it. Parasite
+// powered sensors can't answer while the pullup is held, so they get the
+// datasheet worst case for their resolution.
+bool Sensors::busConversionDone(byte bus) {
+  BusConversion &conversion = conversions[bus];
+
+  if (conversion.done) return true;
+
+  if (millis() - conversion.started >= conversion.time ||
+      (!conversion.pullup && buses[bus]->read_bit())) {
+    conversion.done = !conversion.serial || !startSerialConversion(bus);
+  }
+  return conversion.done;
+}
+
+// Works out how the bus has to be driven through a conversion from the
+// power mode each sensor reported when it was found.
+void Sensors::updatePowerMode(byte bus) {
+  BusConversion &conversion = conversions[bus];
+  byte parasiteCount = 0;
+
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    if (it->bus == bus && it->parasite) parasiteCount++;
+  }
+  conversion.parasite = parasiteCount > 0;
+  conversion.serial = parasiteCount > PARASITE_MAX_CONVERSIONS;
+
+  Serial.print("Parasite Powered Sensors: ");
+  Serial.println(parasiteCount);
+  if (conversion.serial) Serial.println("Converting One Sensor At A Time");
+}
+
+bool Sensors::busy() {
+  return state != ACQUIRE_IDLE;
+}
+
+// One step of the alarm search, flagging the sensor that answered. The
+// buses are searched one after the other. Returns false once there are no
+// more alarmed sensors on any of them.
+bool Sensors::alarmSearch() {
+  byte addr[SENSOR_ADDR_SIZE];
+  Sensor* sensor;
+
+  while (alarmBus < busCount && !buses[alarmBus]->search(addr, false)) {
+    alarmBus++;
+  }
+  if (alarmBus == busCount) return false;
+  if (OneWire::crc8(addr, 7) != addr[7]) return true;
+
+  sensor = find(addr);
+  if (sensor != NULL) sensor->alarmed = true;
+  return true;
+}
+
+void Sensors::startReading() {
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    it->pending = !it->quarantined && needsRead(*it);
+    it->retriesLeft = READ_RETRIES;
+  }
+  readBus = 0;
+  state = ACQUIRE_READING;
+}
+
+// Picks the next sensor to read, taking the buses in turn so that no one
+// bus's sensors hold up the rest. A bus with a read running in the
+// background comes back to that sensor until it's collected.
+Sensor* Sensors::nextRead() {
+  for (byte tries = 0; tries < busCount; tries++) {
+    byte bus = readBus;
+    readBus = (readBus + 1) % busCount;
+
+#if ONEWIRE_ASYNC
+    if (queued != NULL && queued->bus == bus) return queued;
+#endif
+    Sensor* sensor = pendingOn(bus);
+    if (sensor != NULL) return sensor;
+  }
+  return NULL;
+}
+
+Sensor* Sensors::pendingOn(byte bus) {
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    if (it->pending && it->bus == bus) return it;
+  }
+  return NULL;
+}
+
+// Reads one sensor's scratchpad. Returns false if the read should be tried
+// again on the next poll, which only needs the scratchpad re-read, not a
+// new conversion, or if it's still running in the background.
+bool Sensors::readNext(Sensor &sensor) {
+  unsigned long started = micros();
+
+#if ONEWIRE_ASYNC
+  if (buses[sensor.bus] == async) return readQueued(sensor);
+#endif
+#if ONEWIRE_PARALLEL
+  if (parallel != NULL) return readLanes(sensor);
+#endif
+  return readDone(sensor, sensor.readScratchpad(), started);
+}
+
+#if ONEWIRE_ASYNC
+// Reads on the timer driven bus are queued on the first call and picked up
+// on a later one, once the bus has gone idle, so poll() doesn't wait for
+// the bus time either.
+bool Sensors::readQueued(Sensor &sensor) {
+  if (queued != &sensor) {
+    sensor.queueScratchpad(*async);
+    queued = &sensor;
+    queuedAt = micros();
+    return false;
+  }
+  if (!async->idle()) return false;
+
+  queued = NULL;
+  return readDone(sensor, sensor.collectScratchpad(*async), queuedAt);
+}
+#endif
+
+#if ONEWIRE_PARALLEL
+// Reads `sensor` together with the next pending sensor on each of the
+// other lanes, in the same slots, so every lane's read takes the bus time
+// of one. The other lanes' sensors are done with here, retries aside;
+// what's returned is for `sensor`.
+bool Sensors::readLanes(Sensor &sensor) {
+  Sensor* reading[MAX_BUSES];
+  byte roms[ONEWIRE_PARALLEL_LANES][8];
+  byte recalls[ONEWIRE_PARALLEL_LANES][SCRATCHPAD_COMMAND_SIZE];
+  byte recallLengths[ONEWIRE_PARALLEL_LANES] = {};
+  byte commands[ONEWIRE_PARALLEL_LANES][SCRATCHPAD_COMMAND_SIZE];
+  byte lengths[ONEWIRE_PARALLEL_LANES] = {};
+  byte v[ONEWIRE_PARALLEL_LANES];
+  Scratchpad scratchpads[MAX_BUSES];
+  uint8_t active = 0;
+  uint8_t recalling = 0;
+  uint8_t present;
+  unsigned long started = micros();
+  bool done = false;
+
+  for (byte bus = 0; bus < busCount; bus++) {
+    reading[bus] = bus == sensor.bus ? &sensor : pendingOn(bus);
+    if (reading[bus] == NULL) continue;
+
+    active |= 1 << bus;
+    memcpy(roms[bus], reading[bus]->addr, SENSOR_ADDR_SIZE);
+    recallLengths[bus] = reading[bus]->family->recall(recalls[bus]);
+    if (recallLengths[bus]) recalling |= 1 << bus;
+    lengths[bus] = reading[bus]->family->command(commands[bus]);
+  }
+
+  // DS2438 lanes recall page 0 first, the others wait that transaction out.
+  // A lane that misses either presence pulse has no reading.
+  present = active & ~recalling;
+  if (recalling) {
+    uint8_t recalled = parallel->reset(recalling);
+
+    parallel->select(roms, recalled);
+    writeLanes(recalls, recallLengths, recalled);
+    present |= recalled;
+  }
+
+  present &= parallel->reset(active);
+  parallel->select(roms, present);
+  // the DS2438 names a page, the rest sit the second byte out
+  writeLanes(commands, lengths, present);
+  for (byte i = 0; i < SCRATCHPAD_SIZE; i++) {
+    parallel->read(v, present);
+    for (byte bus = 0; bus < busCount; bus++) scratchpads[bus].data[i] = v[bus];
+  }
+
+  for (byte bus = 0; bus < busCount; bus++) {
+    Sensor* it = reading[bus];
+    bool finished;
+
+    if (it == NULL) continue;
+
+    finished = readDone(*it, it->readScratchpad(present & (1 << bus), scratchpads[bus]), started);
+    if (it == &sensor) {
+      done = finished;
+    } else if (finished) {
+      it->pending = false;
+    }
+  }
+  return done;
+}
+
+// Writes each lane's command bytes in the same slots, lanes with shorter
+// commands leaving the line alone once theirs is out
+void Sensors::writeLanes(byte commands[][SCRATCHPAD_COMMAND_SIZE], const byte lengths[], uint8_t lanes) {
+  byte v[ONEWIRE_PARALLEL_LANES];
+
+  for (byte i = 0; i < SCRATCHPAD_COMMAND_SIZE; i++) {
+    uint8_t writing = 0;
+
+    for (byte bus = 0; bus < busCount; bus++) {
+      v[bus] = commands[bus][i];
+      if (lengths[bus] > i) writing |= 1 << bus;
+    }
+    parallel->write(v, writing & lanes);
+  }
+}
+#endif
+
+// Counts the outcome of a read against the bus and the sensor. Returns
+// false if it should be retried.
+bool Sensors::readDone(Sensor &sensor, ReadResult result, unsigned long started) {
+  BusStats &bus = stats[sensor.bus];
+
+  switch (result) {
+  case READ_NO_PRESENCE:
+    bus.presenceFailures++;
+    break;
+  case READ_CRC_ERROR:
+    bus.crcErrors++;
+    break;
+  case READ_OUT_OF_RANGE:
+    bus.rangeErrors++;
+    break;
+  case READ_OK:
+    break;
+  }
+
+  bus.scratchpad.observe(micros() - started);
+
+  // An out of range value would read back the same, so only retry reads
+  // that got garbled or lost on the wire
+  if ((result == READ_CRC_ERROR || result == READ_NO_PRESENCE) && sensor.retriesLeft > 0) {
+    sensor.retriesLeft--;
+    sensor.retries++;
+    bus.retries++;
+    return false;
+  }
+
+  if (result == READ_OK) {
+    sensor.readSucceeded();
+    anyRead = true;
+  } else {
+    sensor.readFailed(millis());
+  }
+  return true;
+}
+
+// Reset the bus, keeping track of how long it took and whether anything
+// answered.
+bool Sensors::resetBus(byte bus) {
+  unsigned long started = micros();
+  bool present = buses[bus]->reset();
+
+  stats[bus].reset.observe(micros() - started);
+  if (!present) stats[bus].presenceFailures++;
+
+  return present;
 }
 
-float Sensors::averageTemperatures() {
-  return averageGreaterThanZero(begin(sensors), end(sensors), &Sensor::temp);
+// Sensors that answered the alarm search are read whether they're due or
+// not, they've left the control band.
+bool Sensors::needsRead(const Sensor& sensor) {
+  if (sensor.id == 0) return false;
+  if (controlOnly && sensor.alarmed) return true;
+
+  return sensor.due && (!controlOnly || !sensor.alarmArmed);
 }
 
-float Sensors::minuteAverageTemperatures() {
-  return averageGreaterThanZero(begin(sensors), end(sensors), &Sensor::minute_average);
+bool Sensors::nearControlBand() {
+  if (!alarmWindowSet || minute_average == RAW_TEMP_INVALID) return false;
+
+  return minute_average < controlLow + SAMPLE_GUARD ||
+    minute_average > controlHigh - SAMPLE_GUARD;
 }
 
-void Sensors::read() {
-  for (std::list<Sensor>::iterator it=sensors.begin(); it != sensors.end(); ++it) {
+// Sets the control band, in degrees F. It's written to the sensors' TH/TL
+// registers at the start of the next acquisition cycle. The sensors only
+// compare whole degrees C, so the band is rounded outwards (down for both
+// edges, matching how the sensor truncates) and a sensor may raise its
+// alarm slightly early, never late.
+void Sensors::setAlarmWindow(float onTemp, float offTemp) {
+  alarmLow = static_cast<int8_t>(floor((onTemp - 32.0) / 1.8));
+  alarmHigh = static_cast<int8_t>(floor((offTemp - 32.0) / 1.8));
+  controlLow = static_cast<RawTemp>(lround((onTemp - 32.0) * 16 / 1.8));
+  controlHigh = static_cast<RawTemp>(lround((offTemp - 32.0) * 16 / 1.8));
+  alarmWindowSet = true;
+  alarmsDirty = true;
+}
+
+void Sensors::programAlarms() {
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
     if (it->id == 0) continue;
 
-    it->read();
+    it->setAlarm(alarmHigh, alarmLow);
   }
+  alarmsDirty = false;
+}
+
+// Returns how many sensors took the new resolution, or -1 if an
+// acquisition cycle is using the bus.
+int Sensors::setResolution(byte bits, bool persist) {
+  int configured = 0;
 
-  temp = averageTemperatures();
-  minute_average = minuteAverageTemperatures();
+  if (busy()) return -1;
+
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    if (it->id == 0) continue;
+
+    if (it->setResolution(bits, persist)) configured++;
+  }
+  return configured;
 }
 
-bool isByteArrayEmpty(byte b[]) {
-  bool empty = true;
-  for (unsigned int i = 0; empty == true && i < sizeof(b); i++) {
-    if (b[i] != 0x00) empty = false;
+// Runs `samples` back to back conversions per acquisition cycle and
+// averages them into a single window sample on each sensor.
+int Sensors::setOversample(byte samples) {
+  if (busy() || samples < 1) return -1;
+
+  oversample = samples;
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    it->oversample = samples;
   }
-  return empty;
+  return samples;
 }
 
-void Sensors::scan() {
-  byte type_s;
+// Picks the filter every sensor's samples pass through before the window
+int Sensors::setFilter(FilterMode mode) {
+  if (busy()) return -1;
+
+  filterMode = mode;
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    it->setFilter(mode);
+  }
+  return mode;
+}
+
+Sensor* Sensors::find(const byte addr[SENSOR_ADDR_SIZE]) {
+  return sensors.find(romKey(addr));
+}
+
+bool Sensors::contains(const byte addr[SENSOR_ADDR_SIZE]) {
+  return sensors.contains(romKey(addr));
+}
+
+Sensor* Sensors::busSensor(byte bus, byte index) {
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    if (it->bus != bus) continue;
+
+    if (index-- == 0) return it;
+  }
+  return NULL;
+}
+
+int Sensors::busSensorCount(byte bus) {
+  int count = 0;
+
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    if (it->bus == bus) count++;
+  }
+  return count;
+}
+
+// Cheaply checks whether the bus still holds exactly the known sensors.
+// A sensor that was the only device of any kind on the bus just answers
+// Read ROM, other devices would collide with it; otherwise each known ROM is
+// verified with a single forced search pass, at overdrive speed for the
+// sensors that take it. New sensors can't be seen this way, so scan()
+// still runs a full search every FULL_SEARCH_EVERY.
+bool Sensors::topologyChanged(byte bus) {
+  OneWire & ds = *buses[bus];
   byte addr[SENSOR_ADDR_SIZE];
-  byte sensorAddrs[MAX_SENSORS][SENSOR_ADDR_SIZE];
-  int sensor_id = 1;
-  bool found = false;
+  int known = busSensorCount(bus);
+  bool present = resetBus(bus);
+  bool changed = false;
+  bool overdrive = false;
+
+  if (present != (known > 0)) return true;
+  if (!present) return false;
 
-  // Zero out all the sensor addresses;
-  for (int i = 0; i < MAX_SENSORS; i++) {
-    for (int j = 0; j < SENSOR_ADDR_SIZE; j++) {
-      sensorAddrs[i][j] = 0x00;
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    if (it->bus != bus) continue;
+
+    if (known == 1 && busDevices[bus] == 1) {
+      return !ds.read_rom(addr) ||
+        OneWire::crc8(addr, 7) != addr[7] ||
+        !compareSensorAddresses(addr, it->addr);
+    }
+    if (it->overdrive) {
+      overdrive = true;
+    } else if (!ds.verify(it->addr)) {
+      return true;
     }
   }
+  if (!overdrive) return false;
 
-  // Read up to 10 sensors off the bus
-  while (sensor_id <= MAX_SENSORS && findAndValidateDeviceAddress(addr, ds)) {
-    memcpy(sensorAddrs[sensor_id], &addr, SENSOR_ADDR_SIZE);
+  // Overdrive resets are only answered by the devices moved to overdrive
+  if (!ds.overdrive_skip()) return true;
+  for (Sensor* it=sensors.begin(); !changed && it != sensors.end(); ++it) {
+    if (it->bus == bus && it->overdrive && !ds.verify(it->addr)) changed = true;
   }
+  ds.set_overdrive(false);
+  ds.reset();
+
+  return changed;
+}
+
+void Sensors::scan() {
+  bool fullSearch = ++scansSinceSearch >= FULL_SEARCH_EVERY;
 
-  // For each new sensor read, add it to the sensors list if it doesn't exist
-  for (int i = 0; i < MAX_SENSORS; i++) {
-    if (isByteArrayEmpty(sensorAddrs[i])) continue;
+  if (fullSearch) scansSinceSearch = 0;
 
-    found = false;
-    for (std::list<Sensor>::const_iterator iter = sensors.begin(); iter != sensors.end(); ++iter) {
-      if (compareSensorAddresses(sensorAddrs[i], iter->addr)) {
-        found = true;
-      }
+  for (byte bus = 0; bus < busCount; bus++) {
+    if (fullSearch || topologyChanged(bus)) {
+      search(bus);
+    } else {
+      Serial.println("Sensors Verified");
+    }
+
+    buses[bus]->reset();
+  }
+}
+
+// Full ROM search of one bus, adding new sensors and dropping missing ones
+void Sensors::search(byte bus) {
+  OneWire & ds = *buses[bus];
+  byte addr[SENSOR_ADDR_SIZE];
+  byte sensorAddrs[MAX_SENSORS][SENSOR_ADDR_SIZE];
+  uint64_t keys[MAX_SENSORS];
+  int found = 0;
+  unsigned long started = micros();
+
+  // Read up to MAX_SENSORS sensors off the bus
+  ds.reset_search();
+  while (found < MAX_SENSORS && findAndValidateDeviceAddress(addr, ds)) {
+    memcpy(sensorAddrs[found], addr, SENSOR_ADDR_SIZE);
+    keys[found] = romKey(addr);
+    found++;
+  }
+  // Finish the search to count the ones there is no room for
+  if (found == MAX_SENSORS) {
+    while (findAndValidateDeviceAddress(addr, ds)) {
+      Serial.println("Bus Full, Dropping Sensor");
+      stats[bus].droppedDevices++;
     }
+  }
+
+  stats[bus].search.observe(micros() - started);
+  busDevices[bus] = found;
 
-    if (found) {
+  // For each new sensor read, add it to the sensors table if it doesn't exist
+  for (int i = 0; i < found; i++) {
+    if (sensors.contains(keys[i])) {
       Serial.println("Sensor Already Found");
-      sensor_id++;
       continue;
     }
 
-    Sensor sensor = Sensor(ds);
+    const ChipFamily *family = findChipFamily(sensorAddrs[i][0]);
+    if (family == NULL) {
+      Serial.println("Not a Temperature Sensor");
+      continue;
+    }
 
-    type_s = chipType(sensorAddrs[i][0]);
+    Sensor sensor = Sensor(ds);
 
-    sensor.id = sensor_id;
-    sensor.type = type_s;
+    sensor.id = bus * MAX_SENSORS + i + 1;
+    sensor.bus = bus;
+    sensor.family = family;
+    sensor.oversample = oversample;
+    sensor.setFilter(filterMode);
+    sensor.history = &history;
 
     Serial.print("SensorID: ");
     Serial.print(sensor.id);
     Serial.print("    Sensor Type: ");
-    Serial.println(sensor.type);
+    Serial.println(family->name);
 
     memcpy(&sensor.addr, &sensorAddrs[i], SENSOR_ADDR_SIZE);
+    sensor.readPowerSupply();
+    sensor.probeOverdrive();
 
-    sensors.push_front(sensor);
+    if (sensors.insert(keys[i], sensor) == NULL) {
+      Serial.println("Sensor Table Full");
+      stats[bus].droppedDevices++;
+      continue;
+    }
 
-    sensor_id++;
+    alarmsDirty = alarmWindowSet;
   }
 
   Serial.println("Removing Missing Sensors");
-  for (std::list<Sensor>::iterator it=sensors.begin(); it != sensors.end(); ++it) {
-    if (it->id == 0) continue;
-
-    found = false;
-    for (int i = 0; i < MAX_SENSORS; i++) {
-      if (isByteArrayEmpty(sensorAddrs[i])) continue;
-
-      if (compareSensorAddresses(sensorAddrs[i], it->addr)) {
-        found = true;
-      }
-    }
+  sensors.remove_if([&keys, found, bus](const Sensor& sensor) {
+    if (sensor.bus != bus) return false;
 
-    if (found) {
-      continue;
+    uint64_t key = romKey(sensor.addr);
+    for (int i = 0; i < found; i++) {
+      if (keys[i] == key) return false;
     }
-
     Serial.println("Found a Sensor to Remove");
-    sensors.remove(*it);
-  }
+    return true;
+  });
 
-  ds.reset();
+  updatePowerMode(bus);
 }
 
 void Sensors::debug() {
   Serial.println("## Sensors ##");
-  for (std::list<Sensor>::iterator it=sensors.begin(); it != sensors.end(); ++it) {
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
     if (it->id == 0) continue;
 
-    const char* name = getChipName(it->type);
     char sensorMessage[75];
     snprintf(
       sensorMessage,
       75,
-      "Sensor #%i, Type: %i - %s, Address: %x %x %x %x %x %x %x %x",
+      "Sensor #%i, Type: %s, Address: %x %x %x %x %x %x %x %x",
       it->id,
-      it->type,
-      name,
+      it->family->name,
       it->addr[0],
       it->addr[1],
       it->addr[2],
@@ -183,6 +745,271 @@ void Sensors::debug() {
   }
 }
 
+static void writeCounter(Print &out, const char *name, const char *labels, uint32_t value) {
+  char line[120];
+
+  snprintf(line, sizeof(line), "%s{%s} %" PRIu32 "\n", name, labels, value);
+  out.print(line);
+}
+
+static void busLabels(char *labels, size_t size, byte bus) {
+  snprintf(labels, size, "bus=\"%u\"", bus);
+}
+
+static void sensorLabels(char *labels, size_t size, const Sensor &sensor) {
+  snprintf(labels, size, "bus=\"%u\",sensor=\"%02x%02x%02x%02x%02x%02x%02x%02x\"",
+    sensor.bus,
+    sensor.addr[0], sensor.addr[1], sensor.addr[2], sensor.addr[3],
+    sensor.addr[4], sensor.addr[5], sensor.addr[6], sensor.addr[7]);
+}
+
+// `fahrenheit` scaled by FAHRENHEIT_SCALE
+static void writeGauge(Print &out, const char *name, const char *labels, const char *stat, int32_t fahrenheit) {
+  char line[120];
+  char value[16];
+
+  formatFixed(value, sizeof(value), fahrenheit, 4);
+  snprintf(line, sizeof(line), "%s{%s,stat=\"%s\"} %s\n", name, labels, stat, value);
+  out.print(line);
+}
+
+// In degrees F. Nothing is written until there's a reading.
+static void writeStats(Print &out, const char *name, const char *labels, const Stats &stats) {
+  if (stats.count == 0) return;
+
+  writeGauge(out, name, labels, "min", rawToFahrenheit(stats.minimum()));
+  writeGauge(out, name, labels, "max", rawToFahrenheit(stats.maximum()));
+  writeGauge(out, name, labels, "mean", rawToFahrenheit(stats.mean()));
+  writeGauge(out, name, labels, "stddev", divRound(rawDeltaToFahrenheit(stats.stddev16()), 16));
+}
+
+static const char *ROLLUP_TIMESPANS[ROLLUP_LEVELS] = { "1m", "5m", "1h" };
+
+static void rollupLabels(char *levelLabels, size_t size, const char *labels, byte level) {
+  snprintf(levelLabels, size, "%s%stimespan=\"%s\"", labels, *labels ? "," : "", ROLLUP_TIMESPANS[level]);
+}
+
+// The last closed bucket of each level, in degrees F. `labels` may be empty.
+template<class RollupsType>
+static void writeRollupDegrees(Print &out, const char *name, const char *labels, const RollupsType &rollups) {
+  char levelLabels[80];
+
+  for (byte level = 0; level < ROLLUP_LEVELS; level++) {
+    const RollupBucket *bucket = rollups.latest(static_cast<RollupLevel>(level));
+    if (bucket == NULL) continue;
+
+    rollupLabels(levelLabels, sizeof(levelLabels), labels, level);
+    writeGauge(out, name, levelLabels, "min", rawToFahrenheit(bucket->min));
+    writeGauge(out, name, levelLabels, "max", rawToFahrenheit(bucket->max));
+    writeGauge(out, name, levelLabels, "mean", rawToFahrenheit(bucket->mean()));
+  }
+}
+
+template<class RollupsType>
+static void writeRollupSamples(Print &out, const char *name, const char *labels, const RollupsType &rollups) {
+  char levelLabels[80];
+
+  for (byte level = 0; level < ROLLUP_LEVELS; level++) {
+    const RollupBucket *bucket = rollups.latest(static_cast<RollupLevel>(level));
+    if (bucket == NULL) continue;
+
+    rollupLabels(levelLabels, sizeof(levelLabels), labels, level);
+    writeCounter(out, name, levelLabels, bucket->count);
+  }
+}
+
+// Bus and sensor health in the Prometheus text format
+void Sensors::metrics(Print &out) {
+  char labels[60];
+  byte bus;
+  uint32_t now = millis() / 1000;
+
+  out.print("# TYPE onewire_presence_failures_total counter\n");
+  for (bus = 0; bus < busCount; bus++) {
+    busLabels(labels, sizeof(labels), bus);
+    writeCounter(out, "onewire_presence_failures_total", labels, stats[bus].presenceFailures);
+  }
+  out.print("# TYPE onewire_crc_errors_total counter\n");
+  for (bus = 0; bus < busCount; bus++) {
+    busLabels(labels, sizeof(labels), bus);
+    writeCounter(out, "onewire_crc_errors_total", labels, stats[bus].crcErrors);
+  }
+  out.print("# TYPE onewire_range_errors_total counter\n");
+  for (bus = 0; bus < busCount; bus++) {
+    busLabels(labels, sizeof(labels), bus);
+    writeCounter(out, "onewire_range_errors_total", labels, stats[bus].rangeErrors);
+  }
+  out.print("# TYPE onewire_read_retries_total counter\n");
+  for (bus = 0; bus < busCount; bus++) {
+    busLabels(labels, sizeof(labels), bus);
+    writeCounter(out, "onewire_read_retries_total", labels, stats[bus].retries);
+  }
+  out.print("# TYPE onewire_dropped_devices_total counter\n");
+  for (bus = 0; bus < busCount; bus++) {
+    busLabels(labels, sizeof(labels), bus);
+    writeCounter(out, "onewire_dropped_devices_total", labels, stats[bus].droppedDevices);
+  }
+  out.print("# TYPE onewire_history_chunks_used gauge\n");
+  snprintf(labels, sizeof(labels), "onewire_history_chunks_used %u\n", history.chunksUsed());
+  out.print(labels);
+  out.print("# TYPE onewire_skipped_cycles_total counter\n");
+  snprintf(labels, sizeof(labels), "onewire_skipped_cycles_total %" PRIu32 "\n", skippedCycles);
+  out.print(labels);
+  out.print("# TYPE onewire_search_discrepancies_total counter\n");
+  for (bus = 0; bus < busCount; bus++) {
+    busLabels(labels, sizeof(labels), bus);
+    writeCounter(out, "onewire_search_discrepancies_total", labels, buses[bus]->search_discrepancies);
+  }
+
+  out.print("# TYPE onewire_sensor_presence_failures_total counter\n");
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    sensorLabels(labels, sizeof(labels), *it);
+    writeCounter(out, "onewire_sensor_presence_failures_total", labels, it->presenceFailures);
+  }
+  out.print("# TYPE onewire_sensor_crc_errors_total counter\n");
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    sensorLabels(labels, sizeof(labels), *it);
+    writeCounter(out, "onewire_sensor_crc_errors_total", labels, it->crcErrors);
+  }
+  out.print("# TYPE onewire_sensor_range_errors_total counter\n");
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    sensorLabels(labels, sizeof(labels), *it);
+    writeCounter(out, "onewire_sensor_range_errors_total", labels, it->rangeErrors);
+  }
+
+  out.print("# TYPE onewire_sensor_read_retries_total counter\n");
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    sensorLabels(labels, sizeof(labels), *it);
+    writeCounter(out, "onewire_sensor_read_retries_total", labels, it->retries);
+  }
+  out.print("# TYPE onewire_sensor_quarantines_total counter\n");
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    sensorLabels(labels, sizeof(labels), *it);
+    writeCounter(out, "onewire_sensor_quarantines_total", labels, it->quarantines);
+  }
+  out.print("# TYPE onewire_sensor_quarantined gauge\n");
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    sensorLabels(labels, sizeof(labels), *it);
+    writeCounter(out, "onewire_sensor_quarantined", labels, it->quarantined ? 1 : 0);
+  }
+
+  out.print("# TYPE onewire_sensor_sample_interval_cycles gauge\n");
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    sensorLabels(labels, sizeof(labels), *it);
+    writeCounter(out, "onewire_sensor_sample_interval_cycles", labels, it->interval);
+  }
+
+  out.print("# TYPE onewire_reset_seconds histogram\n");
+  for (bus = 0; bus < busCount; bus++) {
+    busLabels(labels, sizeof(labels), bus);
+    stats[bus].reset.write(out, "onewire_reset_seconds", labels);
+  }
+  out.print("# TYPE onewire_search_seconds histogram\n");
+  for (bus = 0; bus < busCount; bus++) {
+    busLabels(labels, sizeof(labels), bus);
+    stats[bus].search.write(out, "onewire_search_seconds", labels);
+  }
+  out.print("# TYPE onewire_scratchpad_read_seconds histogram\n");
+  for (bus = 0; bus < busCount; bus++) {
+    busLabels(labels, sizeof(labels), bus);
+    stats[bus].scratchpad.write(out, "onewire_scratchpad_read_seconds", labels);
+  }
+  out.print("# TYPE onewire_conversion_wait_seconds histogram\n");
+  conversionWait.write(out, "onewire_conversion_wait_seconds", "");
+
+  out.print("# TYPE onewire_temp_degrees gauge\n");
+  writeStats(out, "onewire_temp_degrees", "timespan=\"none\"", tempStats);
+  writeStats(out, "onewire_temp_degrees", "timespan=\"minute\"", averageStats);
+  out.print("# TYPE onewire_sensor_window_degrees gauge\n");
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    sensorLabels(labels, sizeof(labels), *it);
+    writeStats(out, "onewire_sensor_window_degrees", labels, it->windowStats());
+  }
+
+  // Close out buckets even when no samples have come in to do it
+  rollups.settle(now);
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    it->rollups.settle(now);
+  }
+  out.print("# TYPE onewire_temp_rollup_degrees gauge\n");
+  writeRollupDegrees(out, "onewire_temp_rollup_degrees", "", rollups);
+  out.print("# TYPE onewire_temp_rollup_samples gauge\n");
+  writeRollupSamples(out, "onewire_temp_rollup_samples", "", rollups);
+  out.print("# TYPE onewire_sensor_rollup_degrees gauge\n");
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    sensorLabels(labels, sizeof(labels), *it);
+    writeRollupDegrees(out, "onewire_sensor_rollup_degrees", labels, it->rollups);
+  }
+  out.print("# TYPE onewire_sensor_rollup_samples gauge\n");
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    sensorLabels(labels, sizeof(labels), *it);
+    writeRollupSamples(out, "onewire_sensor_rollup_samples", labels, it->rollups);
+  }
+  out.print("\n");
+}
+
+static void romHex(char *hex, size_t size, const byte addr[SENSOR_ADDR_SIZE]) {
+  snprintf(hex, size, "%02x%02x%02x%02x%02x%02x%02x%02x",
+    addr[0], addr[1], addr[2], addr[3], addr[4], addr[5], addr[6], addr[7]);
+}
+
+// What the history holds for each sensor, so a client knows what to page
+// through with writeHistory(). `clockOffset` turns uptime seconds into
+// unix time.
+void Sensors::writeHistoryIndex(Print &out, int32_t clockOffset) {
+  char hex[17];
+  char line[80];
+
+  out.print("sensor,samples,first,last\n");
+  for (Sensor* it=sensors.begin(); it != sensors.end(); ++it) {
+    uint64_t key = romKey(it->addr);
+    const SeriesChunk *first = history.nextChunk(key, 0);
+    const SeriesChunk *last = first;
+    uint32_t samples = 0;
+
+    if (first == NULL) continue;
+
+    for (const SeriesChunk *chunk = first; chunk != NULL; chunk = history.nextChunk(key, chunk->seq)) {
+      samples += chunk->count;
+      last = chunk;
+    }
+
+    romHex(hex, sizeof(hex), it->addr);
+    snprintf(line, sizeof(line), "%s,%" PRIu32 ",%" PRIu32 ",%" PRIu32 "\n", hex, samples, first->start + clockOffset, last->last + clockOffset);
+    out.print(line);
+  }
+}
+
+// One page of a sensor's history as CSV, oldest first: at most `limit`
+// samples taken after `since`, in unix seconds. Chunks that end before
+// `since` are passed over undecoded, so a page costs about the same
+// however far into the history it is. Returns the samples written; fewer
+// than `limit` means the history has run out.
+uint16_t Sensors::writeHistory(Print &out, int32_t clockOffset, const byte addr[SENSOR_ADDR_SIZE], uint32_t since, uint16_t limit) {
+  SeriesIterator series(history, romKey(addr));
+  int64_t after = static_cast<int64_t>(since) - clockOffset; // in uptime
+  char hex[17];
+  char line[64];
+  char value[16];
+  uint32_t time;
+  RawTemp sample;
+  uint16_t written = 0;
+
+  if (after > 0) series.skipTo(after);
+  romHex(hex, sizeof(hex), addr);
+
+  out.print("sensor,time,fahrenheit\n");
+  while (written < limit && series.next(time, sample)) {
+    if (static_cast<int64_t>(time) <= after) continue;
+
+    formatFixed(value, sizeof(value), rawToFahrenheit(sample), 4);
+    snprintf(line, sizeof(line), "%s,%" PRIu32 ",%s\n", hex, time + clockOffset, value);
+    out.print(line);
+    written++;
+  }
+  return written;
+}
+
 int Sensors::count() {
   return sensors.size();
 }
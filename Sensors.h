@@ -2,26 +2,168 @@
 #define SENSORS_H_
 
 #include "OneWire.h"
+#include "OneWireAsync.h"
+#include "OneWireParallel.h"
 #include "Sensor.h"
-#include <list>
+#include "elapsedMillis.h"
+#include "Histogram.h"
+#include "SensorTable.h"
 
-#define MAX_SENSORS 10
+#define MAX_BUSES 4
+// Sensors a search keeps per bus, enough for four full 16 sensor runs.
+// Devices found past it are counted in onewire_dropped_devices_total.
+#ifndef MAX_SENSORS
+#define MAX_SENSORS 16
+#endif
+// Sensors kept over all the buses. Each takes a whole Sensor, about 250
+// bytes, so the default is the one full bus the firmware has. The host
+// build raises it for four. Devices past it are counted as dropped too.
+#ifndef SENSOR_CAPACITY
+#define SENSOR_CAPACITY MAX_SENSORS
+#endif
+#define FULL_SEARCH_EVERY 10 // scans between full ROM searches
+#define FULL_READ_EVERY 6 // acquisition cycles between reads of every sensor
+// Parasite powered sensors the strong pullup can carry through a conversion
+// at once. A DS18B20 draws up to 1.5mA converting, so this keeps the pin
+// under 6mA. Buses with more convert one sensor at a time.
+#define PARASITE_MAX_CONVERSIONS 4
+// Every sensor goes back to being read every cycle while the minute average
+// is within SAMPLE_GUARD of the control band or outside it, so sensors that
+// have backed off can't delay the heater. In 1/16 C, so 1 C.
+#define SAMPLE_GUARD 16
 
+// Acquisition runs as a state machine advanced by Sensors::poll() so that
+// loop() never sleeps while a conversion is in progress.
+enum AcquisitionState {
+  ACQUIRE_IDLE,
+  ACQUIRE_CONVERTING,
+  ACQUIRE_ALARM_SEARCH,
+  ACQUIRE_READING,
+  ACQUIRE_PUBLISHING
+};
+
+// How a bus is taken through a conversion
+struct BusConversion {
+  bool parasite = true; // some sensor needs the strong pullup, assume so until probed
+  bool serial = false; // too many parasite sensors to convert at once
+  bool pullup = true; // strong pullup held through the current conversion
+  bool done = false;
+  uint16_t time = CONVERSION_TIME_12_BIT; // deadline for the current conversion
+  unsigned long started = 0; // millis()
+  byte next = 0; // when serial, index on the bus of the next sensor to convert
+};
+
+// Per bus health counters and timings, exported on /metrics
+struct BusStats {
+  uint32_t presenceFailures = 0;
+  uint32_t crcErrors = 0;
+  uint32_t rangeErrors = 0;
+  uint32_t retries = 0;
+  uint32_t droppedDevices = 0; // past MAX_SENSORS, or with the table full
+  Histogram reset;
+  Histogram search;
+  Histogram scratchpad;
+};
+
+// Sensors spread over up to MAX_BUSES OneWire buses. Conversions start on
+// every bus at once and scratchpads are read round robin across the buses.
 class Sensors {
-  OneWire & ds;
-  std::list<Sensor> sensors;
+  OneWire * buses[MAX_BUSES];
+  byte busCount = 0;
+  SensorTable<SENSOR_CAPACITY> sensors;
+  AcquisitionState state = ACQUIRE_IDLE;
+  elapsedMillis conversionTimeElapsed;
+  BusConversion conversions[MAX_BUSES];
+  BusStats stats[MAX_BUSES];
+  byte busDevices[MAX_BUSES] = {}; // devices of any kind the last search found
+  Histogram conversionWait;
+  byte oversample = 1;
+  FilterMode filterMode = FILTER_HAMPEL;
+  byte pass = 0;
+  bool anyRead = false; // some sensor was read this acquisition cycle
+  byte scansSinceSearch = 0;
+  byte cyclesSinceFullRead = 0;
+  bool alarmWindowSet = false;
+  bool alarmsDirty = false;
+  bool controlOnly = false;
+  int8_t alarmLow = 0;
+  int8_t alarmHigh = 0;
+  RawTemp controlLow = 0; // the control band, in 1/16 C
+  RawTemp controlHigh = 0;
+  uint32_t skippedCycles = 0; // cycles with no sensor due
+  byte alarmBus = 0;
+  byte readBus = 0;
+#if ONEWIRE_ASYNC
+  OneWireAsync *async = NULL; // the bus whose scratchpad reads run in the background
+  Sensor *queued = NULL; // whose read is running on it
+  unsigned long queuedAt = 0; // micros()
+#endif
+#if ONEWIRE_PARALLEL
+  OneWireParallel *parallel = NULL; // the buses are its lanes, read all at once
+#endif
+
+  Stats tempStats;
+  Stats averageStats;
+  // The reading across all sensors, bucketed for /metrics. Uptime based,
+  // so the buckets don't line up with the wall clock.
+  Rollups<ROLLUP_MINUTES, ROLLUP_FIVE_MINUTES, ROLLUP_HOURS> rollups;
+  // Every sensor's window samples, compressed. Uptime based too.
+  SeriesStore history;
 
-  float averageTemperatures();
-  float minuteAverageTemperatures();
+  void aggregate();
+  void updatePowerMode(byte bus);
+  bool conversionDone();
+  bool busConversionDone(byte bus);
+  void startConversion();
+  bool startSerialConversion(byte bus);
+  Sensor* busSensor(byte bus, byte index);
+  bool contains(const byte addr[SENSOR_ADDR_SIZE]);
+  Sensor* find(const byte addr[SENSOR_ADDR_SIZE]);
+  void programAlarms();
+  bool alarmSearch();
+  bool needsRead(const Sensor& sensor);
+  bool nearControlBand();
+  void startReading();
+  Sensor* nextRead();
+  Sensor* pendingOn(byte bus);
+  bool readNext(Sensor &sensor);
+  bool readDone(Sensor &sensor, ReadResult result, unsigned long started);
+#if ONEWIRE_ASYNC
+  bool readQueued(Sensor &sensor);
+#endif
+#if ONEWIRE_PARALLEL
+  bool readLanes(Sensor &sensor);
+  void writeLanes(byte commands[][SCRATCHPAD_COMMAND_SIZE], const byte lengths[], uint8_t lanes);
+#endif
+  bool resetBus(byte bus);
+  bool topologyChanged(byte bus);
+  void search(byte bus);
+  int busSensorCount(byte bus);
 
   public:
-    Sensors(OneWire &ds): ds(ds) {}
+    Sensors(OneWire &ds);
+    Sensors(OneWire *buses[], byte count);
+#if ONEWIRE_ASYNC
+    Sensors(OneWireAsync &ds);
+#endif
+#if ONEWIRE_PARALLEL
+    Sensors(OneWireParallel &lanes);
+#endif
     void scan();
-    void read();
+    void start();
+    bool poll();
+    bool busy();
+    int setResolution(byte bits, bool persist = false);
+    int setOversample(byte samples);
+    int setFilter(FilterMode mode);
+    void setAlarmWindow(float onTemp, float offTemp);
     void debug();
+    void metrics(Print &out);
+    void writeHistoryIndex(Print &out, int32_t clockOffset);
+    uint16_t writeHistory(Print &out, int32_t clockOffset, const byte addr[SENSOR_ADDR_SIZE], uint32_t since, uint16_t limit);
     int count();
-    float temp;
-    float minute_average;
+    RawTemp temp = RAW_TEMP_INVALID; // 1/16 C, see FixedTemp.h
+    RawTemp minute_average = RAW_TEMP_INVALID;
 };
 
 #endif // SENSORS_H_
@@ -0,0 +1,246 @@
+#include "SeriesStore.h"
+
+// Folds signed values onto unsigned ones so small magnitudes either side
+// of zero get short codes: 0, -1, 1, -2, 2 ... become 0, 1, 2, 3, 4 ...
+static uint32_t zigzag(int32_t n) {
+  return (static_cast<uint32_t>(n) << 1) ^ static_cast<uint32_t>(n >> 31);
+}
+
+static int32_t unzigzag(uint32_t n) {
+  return static_cast<int32_t>(n >> 1) ^ -static_cast<int32_t>(n & 1);
+}
+
+static void writeBits(SeriesChunk &chunk, uint32_t value, uint8_t bits) {
+  while (bits-- > 0) {
+    uint8_t &byte = chunk.data[chunk.bits >> 3];
+    uint8_t mask = 0x80 >> (chunk.bits & 7);
+
+    if ((value >> bits) & 1) {
+      byte |= mask;
+    } else {
+      byte &= ~mask;
+    }
+    chunk.bits++;
+  }
+}
+
+static uint8_t bitLength(uint32_t n) {
+  uint8_t length = 0;
+
+  while (n != 0) {
+    length++;
+    n >>= 1;
+  }
+  return length;
+}
+
+// Elias gamma: n's length less one in zeros, then n, for n >= 1
+static uint8_t gammaBits(uint32_t n) {
+  return 2 * bitLength(n) - 1;
+}
+
+static void writeGamma(SeriesChunk &chunk, uint32_t n) {
+  writeBits(chunk, 0, bitLength(n) - 1);
+  writeBits(chunk, n, bitLength(n));
+}
+
+static uint8_t timeBits(uint32_t time) {
+  if (time == 0) return 1;
+  if (time < (1UL << 7)) return 2 + 7;
+  if (time < (1UL << 12)) return 3 + 12;
+  return 3 + 32;
+}
+
+static uint8_t valueBits(uint32_t delta) {
+  if (delta == 0) return 1;
+  if (delta <= 4) return 2 + 2;
+  if (delta < (1UL << 6)) return 3 + 6;
+  return 3 + 16;
+}
+
+// Takes the oldest chunk, or a free one, and starts it with the sample
+uint16_t SeriesStore::allocate(uint64_t key, uint32_t now, RawTemp value) {
+  uint16_t oldest = 0;
+
+  for (uint16_t i = 0; i < SERIES_CHUNKS; i++) {
+    if (chunks[i].key == 0) {
+      oldest = i;
+      break;
+    }
+    if (chunks[i].seq < chunks[oldest].seq) oldest = i;
+  }
+
+  SeriesChunk &chunk = chunks[oldest];
+  chunk.key = key;
+  chunk.seq = nextSeq++;
+  chunk.start = now;
+  chunk.last = now;
+  chunk.interval = 0;
+  chunk.first = value;
+  chunk.value = value;
+  chunk.count = 1;
+  chunk.bits = 0;
+  chunk.run = 0;
+  return oldest;
+}
+
+// False if the chunk has no room for the sample
+bool SeriesStore::encode(SeriesChunk &chunk, uint32_t now, RawTemp value) {
+  int32_t interval = static_cast<int32_t>(now - chunk.last);
+  uint32_t time = zigzag(interval - chunk.interval);
+  uint32_t delta = zigzag(value - chunk.value);
+  uint16_t needed;
+
+  if (chunk.count == 0xFFFF) return false;
+
+  if (time == 0 && delta == 0) {
+    chunk.run++;
+  } else {
+    needed = 1 + timeBits(time) + valueBits(delta);
+    if (chunk.run > 0) needed += 1 + gammaBits(chunk.run);
+    if (chunk.bits + needed > SERIES_CHUNK_BYTES * 8) return false;
+
+    if (chunk.run > 0) {
+      writeBits(chunk, 0, 1);
+      writeGamma(chunk, chunk.run);
+      chunk.run = 0;
+    }
+    writeBits(chunk, 1, 1);
+
+    if (time == 0) {
+      writeBits(chunk, 0, 1);
+    } else if (time < (1UL << 7)) {
+      writeBits(chunk, 2, 2);
+      writeBits(chunk, time, 7);
+    } else if (time < (1UL << 12)) {
+      writeBits(chunk, 6, 3);
+      writeBits(chunk, time, 12);
+    } else {
+      writeBits(chunk, 7, 3);
+      writeBits(chunk, time, 32);
+    }
+
+    if (delta == 0) {
+      writeBits(chunk, 0, 1);
+    } else if (delta <= 4) {
+      writeBits(chunk, 2, 2);
+      writeBits(chunk, delta - 1, 2);
+    } else if (delta < (1UL << 6)) {
+      writeBits(chunk, 6, 3);
+      writeBits(chunk, delta, 6);
+    } else {
+      writeBits(chunk, 7, 3);
+      writeBits(chunk, static_cast<uint16_t>(value), 16);
+    }
+  }
+
+  chunk.last = now;
+  chunk.interval = interval;
+  chunk.value = value;
+  chunk.count++;
+  return true;
+}
+
+void SeriesStore::append(uint64_t key, uint16_t &hint, uint32_t now, RawTemp value) {
+  // The hinted chunk may have been recycled for another sensor since
+  if (hint < SERIES_CHUNKS && chunks[hint].key == key && encode(chunks[hint], now, value)) return;
+
+  hint = allocate(key, now, value);
+}
+
+const SeriesChunk *SeriesStore::nextChunk(uint64_t key, uint32_t seq) const {
+  const SeriesChunk *next = NULL;
+
+  for (uint16_t i = 0; i < SERIES_CHUNKS; i++) {
+    const SeriesChunk &chunk = chunks[i];
+
+    if (chunk.key != key || chunk.seq <= seq) continue;
+    if (next == NULL || chunk.seq < next->seq) next = &chunk;
+  }
+  return next;
+}
+
+uint16_t SeriesStore::chunksUsed() const {
+  uint16_t used = 0;
+
+  for (uint16_t i = 0; i < SERIES_CHUNKS; i++) {
+    if (chunks[i].key != 0) used++;
+  }
+  return used;
+}
+
+SeriesIterator::SeriesIterator(const SeriesStore &store, uint64_t key)
+  : store(store), key(key), chunk(store.nextChunk(key, 0)) {}
+
+void SeriesIterator::skipTo(uint32_t since) {
+  while (chunk != NULL && chunk->last <= since) {
+    chunk = store.nextChunk(key, chunk->seq);
+  }
+}
+
+uint32_t SeriesIterator::read(uint8_t bits) {
+  uint32_t value = 0;
+
+  while (bits-- > 0) {
+    value = (value << 1) | ((chunk->data[bit >> 3] >> (7 - (bit & 7))) & 1);
+    bit++;
+  }
+  return value;
+}
+
+bool SeriesIterator::next(uint32_t &time, RawTemp &value) {
+  uint32_t code;
+
+  if (chunk != NULL && index == chunk->count) {
+    chunk = store.nextChunk(key, chunk->seq);
+    index = 0;
+  }
+  if (chunk == NULL) return false;
+
+  if (index == 0) {
+    bit = 0;
+    lastTime = chunk->start;
+    interval = 0;
+    lastValue = chunk->first;
+    repeats = 0;
+  } else if (repeats > 0) {
+    repeats--;
+    lastTime += interval;
+  } else if (bit >= chunk->bits) {
+    // the chunk's run that hasn't been written out yet
+    lastTime += interval;
+  } else if (read(1) == 0) {
+    uint8_t length = 1;
+
+    while (read(1) == 0) length++;
+    repeats = ((1UL << (length - 1)) | read(length - 1)) - 1;
+    lastTime += interval;
+  } else {
+    if (read(1) == 0) {
+      code = 0;
+    } else if (read(1) == 0) {
+      code = read(7);
+    } else if (read(1) == 0) {
+      code = read(12);
+    } else {
+      code = read(32);
+    }
+    interval += unzigzag(code);
+    lastTime += interval;
+
+    if (read(1) == 0) {
+      // unchanged
+    } else if (read(1) == 0) {
+      lastValue += unzigzag(read(2) + 1);
+    } else if (read(1) == 0) {
+      lastValue += unzigzag(read(6));
+    } else {
+      lastValue = static_cast<RawTemp>(read(16));
+    }
+  }
+
+  index++;
+  time = lastTime;
+  value = lastValue;
+  return true;
+}
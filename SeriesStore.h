@@ -0,0 +1,100 @@
+#ifndef SERIES_STORE_H_
+#define SERIES_STORE_H_
+
+#include "FixedTemp.h"
+#include <stdint.h>
+
+// The history pool: SERIES_CHUNKS chunks of SERIES_CHUNK_BYTES encoded
+// samples plus a 40 byte header each, shared by every sensor. When it's
+// full the oldest chunk is reused.
+//
+// At a sample every 10s, bench/series_store_bench.cpp measures about 174
+// samples a chunk for a reading flickering by 1/16 C (3.9 bits a sample),
+// 108 for +-2/16 C noise and thousands for a steady one. The default 6KB
+// pool so keeps about 6 hours of 4 flickering sensors, 2 hours of 10 and
+// half an hour of 40; sensors that have backed off their read interval
+// last that much longer. Each extra chunk costs 128 bytes of RAM.
+#ifndef SERIES_CHUNKS
+#define SERIES_CHUNKS 48
+#endif
+#define SERIES_CHUNK_BYTES 88
+
+#define SERIES_NO_CHUNK 0xFFFF
+
+// A run of one sensor's samples. The first sample is kept as is, each one
+// after it as a delta of delta timestamp and a value delta, in prefix
+// codes:
+//
+//   0 <run>                    `run` samples at the same interval and value,
+//                              Elias gamma coded
+//   1 <time> <value>           otherwise
+//
+//   time:  0 | 10 +7 bits | 110 +12 bits | 111 +32 bits   zigzag delta of delta, seconds
+//   value: 0 | 10 +2 bits | 110 +6 bits  | 111 +16 bits   zigzag delta, 1/16 C; the
+//                                                        last is the value itself
+//
+// A run is only written out when something changes, until then it's
+// counted in `run`. A sensor read at a steady pace costs 2 bits for a lone
+// unchanged sample, 10 for a run of 16 and 6 for a 1/16 C flicker.
+struct SeriesChunk {
+  uint64_t key = 0; // ROM of the sensor, 0 when free
+  uint32_t seq = 0; // allocation order, oldest first
+  uint32_t start = 0; // time of the first sample, seconds
+  uint32_t last = 0; // time of the latest sample
+  int32_t interval = 0; // between the latest two samples
+  RawTemp first = 0;
+  RawTemp value = 0; // latest
+  uint16_t count = 0;
+  uint16_t bits = 0; // used in data
+  uint16_t run = 0; // unchanged samples not written out yet
+  uint8_t data[SERIES_CHUNK_BYTES];
+};
+
+// Append only, compressed per sensor time series kept in a fixed pool.
+class SeriesStore {
+  SeriesChunk chunks[SERIES_CHUNKS];
+  uint32_t nextSeq = 1;
+
+  uint16_t allocate(uint64_t key, uint32_t now, RawTemp value);
+  bool encode(SeriesChunk &chunk, uint32_t now, RawTemp value);
+
+  public:
+    // Adds a sample to the sensor's series. `hint` is the chunk the
+    // sensor's last sample went into, kept by the caller so appending
+    // doesn't have to look for it; start it at SERIES_NO_CHUNK.
+    void append(uint64_t key, uint16_t &hint, uint32_t now, RawTemp value);
+
+    // The sensor's next chunk after sequence number `seq`, oldest first
+    const SeriesChunk *nextChunk(uint64_t key, uint32_t seq) const;
+
+    uint16_t chunksUsed() const;
+};
+
+// Decodes one sensor's history oldest first, a sample at a time, without
+// copying it out of the store. Appending while iterating is fine as long
+// as it doesn't recycle the chunk being read.
+class SeriesIterator {
+  const SeriesStore &store;
+  uint64_t key;
+  const SeriesChunk *chunk;
+  uint16_t index = 0; // samples of the chunk read so far
+  uint16_t bit = 0;
+  uint16_t repeats = 0; // left of the run being read
+  uint32_t lastTime = 0;
+  int32_t interval = 0;
+  RawTemp lastValue = 0;
+
+  uint32_t read(uint8_t bits);
+
+  public:
+    SeriesIterator(const SeriesStore &store, uint64_t key);
+
+    // Passes over the chunks that end at or before `since` without
+    // decoding them. Only before the first next().
+    void skipTo(uint32_t since);
+
+    // False once the history has run out
+    bool next(uint32_t &time, RawTemp &value);
+};
+
+#endif // SERIES_STORE_H_
@@ -0,0 +1,47 @@
+#ifndef SPSC_RING_H_
+#define SPSC_RING_H_
+
+#include <atomic>
+#include <stdint.h>
+
+// Lock free single producer, single consumer ring buffer. One side may be an
+// interrupt handler: the producer only ever writes `head` and the consumer
+// only ever writes `tail`, so neither needs to disable interrupts.
+// N must be a power of two.
+template<typename T, uint16_t N>
+class SpscRing {
+  static_assert(N && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+  T items[N];
+  std::atomic<uint16_t> head{0};
+  std::atomic<uint16_t> tail{0};
+
+  public:
+    bool push(const T& item) {
+      uint16_t h = head.load(std::memory_order_relaxed);
+      if (static_cast<uint16_t>(h - tail.load(std::memory_order_acquire)) == N) return false;
+
+      items[h & (N - 1)] = item;
+      head.store(h + 1, std::memory_order_release);
+      return true;
+    }
+
+    bool pop(T& item) {
+      uint16_t t = tail.load(std::memory_order_relaxed);
+      if (t == head.load(std::memory_order_acquire)) return false;
+
+      item = items[t & (N - 1)];
+      tail.store(t + 1, std::memory_order_release);
+      return true;
+    }
+
+    bool empty() const {
+      return tail.load(std::memory_order_acquire) == head.load(std::memory_order_acquire);
+    }
+
+    void clear() {
+      tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+};
+
+#endif // SPSC_RING_H_
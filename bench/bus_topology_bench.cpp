@@ -0,0 +1,77 @@
+// Scan and acquisition cycle cost from one bus up to four full ones, the
+// 4x16 topology MAX_SENSORS is sized for. "bus" columns are the time the
+// traffic takes on real buses at standard speed, one after the other as
+// the driver runs them, from OneWireSim::busMicros(); "cycle ms" adds it to
+// the virtual time poll() waited for the conversion. "cpu" is what
+// Sensors and the models cost on this machine.
+#include "OneWireSim.h"
+#include "Sensors.h"
+#include <chrono>
+
+#define CYCLES 5
+
+static double cpuMicrosSince(std::chrono::steady_clock::time_point started) {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count();
+}
+
+static unsigned long long busMicros(OneWireSim lanes[], int count) {
+  unsigned long long total = 0;
+
+  for (int bus = 0; bus < count; bus++) total += lanes[bus].busMicros();
+  return total;
+}
+
+static void resetBusMicros(OneWireSim lanes[], int count) {
+  for (int bus = 0; bus < count; bus++) lanes[bus].resetBusMicros();
+}
+
+int main() {
+  printf("%6s %8s %6s %12s %12s %12s %14s\n",
+    "buses", "devices", "kept", "scan bus ms", "cycle ms", "read bus ms", "cycle cpu us");
+
+  for (int busCount = 1; busCount <= MAX_BUSES; busCount++) {
+    // a full bus, then one with more devices than MAX_SENSORS
+    for (int extra = 0; extra <= 4; extra += 4) {
+      static OneWireSim lanes[MAX_BUSES];
+      OneWire *buses[MAX_BUSES];
+      int devices = busCount * (MAX_SENSORS + extra);
+
+      for (int bus = 0; bus < busCount; bus++) {
+        lanes[bus] = OneWireSim();
+        for (int i = 0; i < MAX_SENSORS + extra; i++) {
+          lanes[bus].addDevice(SIM_DS18B20, 0x9E3779B1UL * (100 * bus + i + 1), 20.0 + i * 0.0625);
+        }
+        buses[bus] = &lanes[bus];
+      }
+
+      Sensors sensors(buses, busCount);
+
+      resetBusMicros(lanes, busCount);
+      sensors.scan();
+      double scanBus = busMicros(lanes, busCount) / 1000.0;
+
+      double cycleMs = 0;
+      double cycleCpu = 0;
+      double readBus = 0;
+      for (int cycle = 0; cycle < CYCLES; cycle++) {
+        unsigned long started = millis();
+
+        resetBusMicros(lanes, busCount);
+        auto cpuStarted = std::chrono::steady_clock::now();
+        sensors.start();
+        while (!sensors.poll()) delay(1);
+        cycleCpu += cpuMicrosSince(cpuStarted);
+        readBus += busMicros(lanes, busCount) / 1000.0;
+        cycleMs += millis() - started + busMicros(lanes, busCount) / 1000.0;
+      }
+
+      if (sensors.count() != busCount * MAX_SENSORS || sensors.temp == RAW_TEMP_INVALID) {
+        fprintf(stderr, "%d buses of %d: kept %d\n", busCount, MAX_SENSORS + extra, sensors.count());
+        return 1;
+      }
+      printf("%6d %8d %6d %12.1f %12.1f %12.1f %14.1f\n", busCount, devices, sensors.count(),
+        scanBus, cycleMs / CYCLES, readBus / CYCLES, cycleCpu / CYCLES);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,31 @@
+// crc8 and crc16 throughput for the ONEWIRE_CRC_TABLE variant this is
+// built with, over ROM and scratchpad sized buffers.
+#include "OneWire.h"
+#include <chrono>
+
+template<typename F>
+static double nanosPerByte(F crc, uint8_t *buf, uint8_t len) {
+  const long rounds = 2000000;
+  volatile uint32_t sink = 0;
+  auto started = std::chrono::steady_clock::now();
+
+  for (long i = 0; i < rounds; i++) {
+    buf[0] = i;
+    sink += crc(buf, len);
+  }
+  (void)sink;
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count() / (rounds * len);
+}
+
+int main() {
+  static const char *names[] = { "bitwise", "256 entry table", "16 entry nibble tables" };
+  uint8_t buf[9] = { 0x28, 0xFF, 0x4C, 0x5C, 0x41, 0x16, 0x03, 0x9A, 0x10 };
+
+  auto crc8 = [](uint8_t *b, uint8_t len) { return static_cast<uint32_t>(OneWire::crc8(b, len)); };
+  auto crc16 = [](uint8_t *b, uint8_t len) { return static_cast<uint32_t>(OneWire::crc16(b, len)); };
+
+  printf("ONEWIRE_CRC_TABLE %d (%s)\n", ONEWIRE_CRC_TABLE, names[ONEWIRE_CRC_TABLE]);
+  printf("  crc8  8 bytes: %6.2f ns/byte, 9 bytes: %6.2f ns/byte\n", nanosPerByte(crc8, buf, 8), nanosPerByte(crc8, buf, 9));
+  printf("  crc16 8 bytes: %6.2f ns/byte, 9 bytes: %6.2f ns/byte\n", nanosPerByte(crc16, buf, 8), nanosPerByte(crc16, buf, 9));
+  return 0;
+}
@@ -0,0 +1,97 @@
+// A DS18B20 scratchpad to the "%.4f" degrees F that /metrics prints, the
+// fixed point way (rawToFahrenheit() and formatFixed()) against the float
+// conversion and snprintf() it replaced, over every reading in range.
+// This machine has an FPU and the Photon doesn't, so the float column is
+// the float path at its best. "differ" counts readings where the float
+// path prints something other than the exact value.
+#include "ChipFamily.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+#define ROUNDS 200
+
+static const int READINGS = RAW_TEMP_MAX - RAW_TEMP_MIN + 1;
+static Scratchpad scratchpads[READINGS];
+
+static double nanosPerReading(std::chrono::steady_clock::time_point started) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count() / (ROUNDS * READINGS);
+}
+
+// As Sensor.cpp had it: celsius from the raw reading, then F
+static float floatFahrenheit(const byte data[]) {
+  int16_t raw = (data[1] << 8) | data[0];
+  float celsius = static_cast<float>(raw) / 16.0;
+
+  return celsius * 1.8 + 32.0;
+}
+
+int main() {
+  static char fixedText[READINGS][16];
+  static char floatText[READINGS][16];
+  volatile int32_t sink = 0;
+  volatile float floatSink = 0;
+  int differ = 0;
+
+  for (int i = 0; i < READINGS; i++) {
+    RawTemp raw = RAW_TEMP_MIN + i;
+    byte *data = scratchpads[i].data;
+
+    data[0] = raw & 0xFF;
+    data[1] = (raw >> 8) & 0xFF;
+    data[2] = 0x4B;
+    data[3] = 0x46;
+    data[4] = 0x7F;
+    data[5] = 0xFF;
+    data[6] = 0x0C;
+    data[7] = 0x10;
+    data[8] = OneWire::crc8(data, 8);
+  }
+
+  auto started = std::chrono::steady_clock::now();
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int i = 0; i < READINGS; i++) {
+      decodeAs<ConfigurableResolutionFamily>(scratchpads[i]);
+      sink += rawToFahrenheit(scratchpads[i].raw);
+    }
+  }
+  double fixedConvert = nanosPerReading(started);
+
+  started = std::chrono::steady_clock::now();
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int i = 0; i < READINGS; i++) {
+      sink += formatFixed(fixedText[i], sizeof(fixedText[i]), rawToFahrenheit(RAW_TEMP_MIN + i), 4);
+    }
+  }
+  double fixedFormat = nanosPerReading(started);
+
+  started = std::chrono::steady_clock::now();
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int i = 0; i < READINGS; i++) {
+      byte *data = scratchpads[i].data;
+
+      if (OneWire::crc8(data, 8) == data[8]) floatSink = floatSink + floatFahrenheit(data);
+    }
+  }
+  double floatConvert = nanosPerReading(started);
+
+  started = std::chrono::steady_clock::now();
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int i = 0; i < READINGS; i++) {
+      sink += snprintf(floatText[i], sizeof(floatText[i]), "%.4f", floatFahrenheit(scratchpads[i].data));
+    }
+  }
+  double floatFormat = nanosPerReading(started);
+
+  for (int i = 0; i < READINGS; i++) {
+    if (strcmp(fixedText[i], floatText[i]) != 0) differ++;
+  }
+
+  printf("%d readings, %.1fF to %.1fF\n", READINGS,
+    rawToFahrenheit(RAW_TEMP_MIN) / static_cast<double>(FAHRENHEIT_SCALE),
+    rawToFahrenheit(RAW_TEMP_MAX) / static_cast<double>(FAHRENHEIT_SCALE));
+  printf("%-8s %12s %12s %12s %8s\n", "path", "convert ns", "format ns", "total ns", "differ");
+  printf("%-8s %12.2f %12.2f %12.2f %8d\n", "fixed", fixedConvert, fixedFormat, fixedConvert + fixedFormat, 0);
+  printf("%-8s %12.2f %12.2f %12.2f %8d\n", "float", floatConvert, floatFormat, floatConvert + floatFormat, differ);
+  return 0;
+}
@@ -0,0 +1,70 @@
+// What each resolution and oversample setting costs and buys, on one
+// simulated DS18B20 whose reading carries 0.1 C of Gaussian noise:
+// conversions a second through Sensor::read() (conversion wait plus the
+// time the bus traffic takes at standard speed), the window samples that
+// makes a minute, and the mean standard deviation of a full window.
+// Samples go into the window unfiltered.
+#include "OneWireSim.h"
+#include "Sensor.h"
+#include <math.h>
+#include <stdio.h>
+
+#define WINDOWS 200
+#define TRUE_CELSIUS 20.03
+#define NOISE_CELSIUS 0.1
+
+static uint32_t seed = 1;
+
+static double uniform() {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return (seed + 0.5) / 4294967296.0;
+}
+
+// Box-Muller
+static double gaussian() {
+  return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform());
+}
+
+int main() {
+  static const byte oversamples[] = { 1, 2, 4, 8 };
+
+  printf("%4s %10s %12s %12s %14s\n", "bits", "oversample", "conv/s", "samples/min", "stddev mC");
+
+  for (byte bits = 9; bits <= 12; bits++) {
+    for (byte oversample : oversamples) {
+      static OneWireSim sim;
+      sim = OneWireSim();
+      sim.addDevice(SIM_DS18B20, 1, TRUE_CELSIUS, true);
+
+      Sensor sensor(sim);
+      memcpy(sensor.addr, sim.device(0).rom, SENSOR_ADDR_SIZE);
+      sensor.family = findChipFamily(sensor.addr[0]);
+      sensor.setFilter(FILTER_NONE);
+      sensor.setResolution(bits);
+      sensor.oversample = oversample;
+
+      unsigned long conversions = 0;
+      double stddevTotal = 0;
+      unsigned long started = millis();
+      sim.resetBusMicros();
+
+      for (int window = 0; window < WINDOWS; window++) {
+        for (int sample = 0; sample < TEMPERATURE_WINDOW * oversample; sample++) {
+          sim.setTemperature(0, TRUE_CELSIUS + NOISE_CELSIUS * gaussian());
+          sensor.read();
+          conversions++;
+        }
+        stddevTotal += sensor.windowStats().stddev16();
+      }
+
+      double seconds = (millis() - started) / 1000.0 + sim.busMicros() / 1e6;
+      double perSecond = conversions / seconds;
+      // stddev16() is in 1/256 C
+      printf("%4u %10u %12.2f %12.1f %14.1f\n", bits, oversample, perSecond,
+        60 * perSecond / oversample, stddevTotal / WINDOWS * 1000 / 256);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,45 @@
+// The per sample cost of the sensor window: the std::list it used to be,
+// trimmed to six samples and averaged by walking the nodes, against
+// RingWindow's running total.
+#include "RingWindow.h"
+#include "FixedTemp.h"
+#include <chrono>
+#include <list>
+#include <stdio.h>
+
+#define WINDOW 6
+#define SAMPLES 2000000L
+
+static RawTemp sample(long i) {
+  return static_cast<RawTemp>(300 + (i * 7919) % 97);
+}
+
+int main() {
+  std::list<RawTemp> list;
+  RingWindow<RawTemp, WINDOW, int32_t> ring;
+  int64_t listSum = 0, ringSum = 0;
+  auto started = std::chrono::steady_clock::now();
+
+  for (long i = 0; i < SAMPLES; i++) {
+    int32_t total = 0;
+
+    if (list.size() == WINDOW) list.erase(list.begin());
+    list.push_back(sample(i));
+    for (RawTemp t : list) total += t;
+    listSum += divRound(total, list.size());
+  }
+  double listNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count() / SAMPLES;
+
+  started = std::chrono::steady_clock::now();
+  for (long i = 0; i < SAMPLES; i++) {
+    ring.push(sample(i));
+    ringSum += divRound(ring.total(), ring.count());
+  }
+  double ringNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count() / SAMPLES;
+
+  printf("window of %d, %ld samples\n", WINDOW, SAMPLES);
+  printf("  std::list   %6.2f ns/sample\n", listNs);
+  printf("  RingWindow  %6.2f ns/sample\n", ringNs);
+  printf("  means %s\n", listSum == ringSum ? "match" : "DIFFER");
+  return listSum == ringSum ? 0 : 1;
+}
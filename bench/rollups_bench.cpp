@@ -0,0 +1,22 @@
+// Per sample cost of Rollups::add(), samples a few seconds apart so the
+// buckets keep closing and cascading
+#include "Rollups.h"
+#include <chrono>
+#include <stdio.h>
+
+#define SAMPLES 5000000L
+
+int main() {
+  static Rollups<ROLLUP_MINUTES, ROLLUP_FIVE_MINUTES, ROLLUP_HOURS> rollups;
+  uint32_t now = 0;
+  auto started = std::chrono::steady_clock::now();
+
+  for (long i = 0; i < SAMPLES; i++) {
+    now += 1 + i % 7;
+    rollups.add(static_cast<RawTemp>(288 + i % 5), now);
+  }
+  printf("Rollups::add %6.2f ns/sample, last hour mean %d\n",
+    std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count() / SAMPLES,
+    rollups.latest(ROLLUP_1H)->mean());
+  return 0;
+}
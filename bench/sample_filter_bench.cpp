@@ -0,0 +1,28 @@
+// Per sample cost of each filter mode, at the FILTER_SIZE this is built with
+#include "SampleFilter.h"
+#include <chrono>
+#include <stdio.h>
+
+#define SAMPLES 5000000L
+
+int main() {
+  static const FilterMode modes[] = { FILTER_NONE, FILTER_MEDIAN, FILTER_EWMA, FILTER_HAMPEL };
+  static const char *names[] = { "none", "median", "ewma", "hampel" };
+  volatile int32_t sink = 0;
+
+  printf("FILTER_SIZE %d\n", FILTER_SIZE);
+  for (FilterMode mode : modes) {
+    SampleFilter filter;
+    auto started = std::chrono::steady_clock::now();
+
+    filter.setMode(mode);
+    for (long i = 0; i < SAMPLES; i++) {
+      // steady with 1/16 C noise, and a spike every 97 samples
+      RawTemp sample = i % 97 == 0 ? 45 * 16 : static_cast<RawTemp>(288 + (i * 7919) % 3 - 1);
+      sink += filter.update(sample);
+    }
+    printf("  %-7s %6.2f ns/sample\n", names[mode],
+      std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count() / SAMPLES);
+  }
+  return 0;
+}
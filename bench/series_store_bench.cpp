@@ -0,0 +1,75 @@
+// How long the history pool holds a sensor for, from the bits a sample
+// actually costs on typical signals, and the encode and decode cost. A
+// sample a TEMP_INTERVAL (10s) apart, read a few milliseconds late each
+// cycle the way loop() does, so the interval occasionally changes by 1s.
+#include "SeriesStore.h"
+#include <chrono>
+#include <stdio.h>
+
+#define SAMPLES 4000
+#define PERIOD_MS 10003
+
+static uint32_t seed = 1;
+
+static uint32_t nextRandom() {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+enum Signal { STEADY, FLICKER, DRIFT, NOISY };
+
+static RawTemp signal(Signal kind, RawTemp last) {
+  switch (kind) {
+  case STEADY: return 288;
+  case FLICKER: return 288 + static_cast<RawTemp>(nextRandom() % 2); // +-1 LSB
+  case DRIFT: return last + static_cast<RawTemp>(nextRandom() % 3) - 1;
+  default: return 288 + static_cast<RawTemp>(nextRandom() % 5) - 2;
+  }
+}
+
+int main() {
+  static const char *names[] = { "steady", "flicker +-1", "drift", "noise +-2" };
+  static const int sensorCounts[] = { 1, 4, 10, 40 };
+
+  printf("%d chunks of %d bytes, a sample every %.1fs\n", SERIES_CHUNKS, SERIES_CHUNK_BYTES, PERIOD_MS / 1000.0);
+  printf("%-12s %8s %8s %12s %12s   hours kept for 1/4/10/40 sensors\n",
+    "signal", "bits", "/chunk", "encode ns", "decode ns");
+
+  for (int kind = STEADY; kind <= NOISY; kind++) {
+    static SeriesStore store;
+    uint16_t hint = SERIES_NO_CHUNK;
+    RawTemp value = 288;
+    uint32_t bits = 0, chunks = 0, time;
+    RawTemp decoded;
+    long count = 0;
+
+    store = SeriesStore();
+    auto started = std::chrono::steady_clock::now();
+    for (long i = 0; i < SAMPLES; i++) {
+      value = signal(static_cast<Signal>(kind), value);
+      store.append(1, hint, static_cast<uint32_t>(i * PERIOD_MS / 1000), value);
+    }
+    double encodeNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count() / SAMPLES;
+
+    started = std::chrono::steady_clock::now();
+    SeriesIterator series(store, 1);
+    while (series.next(time, decoded)) count++;
+    double decodeNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count() / count;
+
+    for (const SeriesChunk *chunk = store.nextChunk(1, 0); chunk != NULL; chunk = store.nextChunk(1, chunk->seq)) {
+      bits += chunk->bits;
+      chunks++;
+    }
+
+    // a chunk's samples, counting the space its last one left unused
+    double perChunk = static_cast<double>(count) / chunks;
+    printf("%-12s %8.2f %8.0f %12.1f %12.1f  ", names[kind], static_cast<double>(bits) / count, perChunk, encodeNs, decodeNs);
+    for (int sensors : sensorCounts) {
+      printf(" %7.1f", SERIES_CHUNKS / static_cast<double>(sensors) * perChunk * PERIOD_MS / 3600000.0);
+    }
+    printf("%s\n", count == SAMPLES ? "" : "  (recycled, raise SAMPLES)");
+  }
+  return 0;
+}
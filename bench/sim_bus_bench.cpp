@@ -0,0 +1,62 @@
+// Scan time and scratchpad read rate against the number of devices on one
+// simulated bus. "bus" columns are the time the same traffic takes on a
+// real bus at standard speed, from OneWireSim::busMicros(); "cpu" columns
+// are what the driver and the models cost on this machine.
+#include "OneWireSim.h"
+#include <chrono>
+
+static_assert(ONEWIRE_SIM_MAX_DEVICES >= 256, "the benchmark needs room for 256 devices");
+
+static double cpuMicrosSince(std::chrono::steady_clock::time_point started) {
+  return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started).count();
+}
+
+int main() {
+  printf("%8s %14s %14s %12s %14s\n", "devices", "scan bus ms", "scan cpu us", "reads/s", "read cpu us");
+
+  for (int devices = 1; devices <= 256; devices *= 2) {
+    static OneWireSim bus;
+    uint8_t roms[256][8];
+    uint8_t data[9];
+    int found = 0;
+    int good = 0;
+
+    bus = OneWireSim();
+    for (int i = 0; i < devices; i++) {
+      bus.addDevice(SIM_DS18B20, 0x9E3779B1UL * (i + 1), 20.0 + i * 0.0625);
+    }
+
+    // a full search, the way Sensors::search() runs it
+    bus.resetBusMicros();
+    auto started = std::chrono::steady_clock::now();
+    bus.reset_search();
+    while (found < devices && bus.search(roms[found])) found++;
+    double scanCpu = cpuMicrosSince(started);
+    double scanBus = bus.busMicros() / 1000.0;
+
+    bus.reset();
+    bus.skip();
+    bus.write(0x44);
+    delay(750);
+
+    // Match ROM and a 9 byte scratchpad read with its CRC, per device
+    bus.resetBusMicros();
+    started = std::chrono::steady_clock::now();
+    for (int i = 0; i < found; i++) {
+      bus.reset();
+      bus.select(roms[i]);
+      bus.write(0xBE);
+      bus.read_bytes(data, 9);
+      if (OneWire::crc8(data, 8) == data[8]) good++;
+    }
+    double readCpu = cpuMicrosSince(started) / found;
+    double readsPerSecond = found * 1e6 / bus.busMicros();
+
+    if (found != devices || good != devices) {
+      fprintf(stderr, "%d devices: found %d, read %d\n", devices, found, good);
+      return 1;
+    }
+    printf("%8d %14.1f %14.1f %12.1f %14.2f\n", devices, scanBus, scanCpu, readsPerSecond, readCpu);
+  }
+  return 0;
+}
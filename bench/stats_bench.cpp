@@ -0,0 +1,41 @@
+// statsOf() per reading from a sensor window's worth to thousands, the
+// lane loop against adding one reading at a time.
+#include "AverageTemps.h"
+#include <chrono>
+#include <stdio.h>
+
+static RawTemp data[10000];
+
+int main() {
+  static const size_t lengths[] = { 10, 100, 1000, 10000 };
+  volatile int32_t sink = 0;
+
+  for (size_t i = 0; i < 10000; i++) {
+    data[i] = i % 13 == 0 ? RAW_TEMP_INVALID : static_cast<RawTemp>(300 + (i * 7919) % 97);
+  }
+
+  printf("%8s %14s %14s\n", "readings", "statsOf ns", "add() ns");
+  for (size_t n : lengths) {
+    long rounds = 20000000L / n;
+    auto started = std::chrono::steady_clock::now();
+
+    for (long r = 0; r < rounds; r++) {
+      data[0] = static_cast<RawTemp>(r & 0xFF);
+      sink += statsOf(data, n).stddev16();
+    }
+    double lanes = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count() / (rounds * n);
+
+    started = std::chrono::steady_clock::now();
+    for (long r = 0; r < rounds; r++) {
+      Stats stats;
+
+      data[0] = static_cast<RawTemp>(r & 0xFF);
+      for (size_t i = 0; i < n; i++) stats.add(data[i]);
+      sink += stats.stddev16();
+    }
+    double serial = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - started).count() / (rounds * n);
+
+    printf("%8zu %14.2f %14.2f\n", n, lanes, serial);
+  }
+  return 0;
+}
@@ -0,0 +1,43 @@
+#include "OneWireSimPin.h"
+
+void OneWireSimPin::drive(bool pulling) {
+  unsigned long now = micros();
+  unsigned long lowFor;
+
+  if (pulling) {
+    low = true;
+    fell = now;
+    return;
+  }
+  if (!low) return;
+
+  low = false;
+  lowFor = now - fell;
+  if (lowFor > longestLow) longestLow = lowFor;
+
+  if (lowFor >= SIM_PIN_RESET_MIN_US) {
+    if (sim.reset()) {
+      holdFrom = now + SIM_PIN_PRESENCE_WAIT_US;
+      holdUntil = holdFrom + SIM_PIN_PRESENCE_US;
+    }
+    return;
+  }
+
+  if ((lowFor >= SIM_PIN_SAMPLE_US && lowFor < SIM_PIN_ZERO_MIN_US) || lowFor > SIM_PIN_ZERO_MAX_US) {
+    badSlots++;
+  }
+
+  if (lowFor >= SIM_PIN_SAMPLE_US) {
+    sim.write_bit(0);
+  } else if (!sim.read_bit()) {
+    holdFrom = fell;
+    holdUntil = fell + SIM_PIN_READ_HOLD_US;
+  }
+}
+
+uint8_t OneWireSimPin::level() {
+  unsigned long now = micros();
+
+  if (low) return LOW;
+  return now >= holdFrom && now < holdUntil ? LOW : HIGH;
+}
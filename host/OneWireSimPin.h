@@ -0,0 +1,43 @@
+#ifndef ONEWIRE_SIM_PIN_H_
+#define ONEWIRE_SIM_PIN_H_
+
+#include "application.h"
+#include "OneWireSim.h"
+
+// Standard speed limits on how long the master holds the line low, in
+// microseconds. Devices sample the line 15us into a slot, so a shorter
+// low is a 1 (or a read slot) and a longer one a 0.
+#define SIM_PIN_SAMPLE_US 15
+#define SIM_PIN_ZERO_MIN_US 60
+#define SIM_PIN_ZERO_MAX_US 120
+#define SIM_PIN_RESET_MIN_US 480
+// How long devices hold the line low themselves: a read slot answering 0,
+// counted from the master's falling edge, and the presence pulse, after
+// the usual wait once the master lets go of a reset
+#define SIM_PIN_READ_HOLD_US 30
+#define SIM_PIN_PRESENCE_WAIT_US 15
+#define SIM_PIN_PRESENCE_US 120
+
+// Puts a OneWireSim on a host pin, so drivers that bit-bang a pin run
+// against the simulated devices. It times each low the master drives and
+// hands it to the simulator as the reset or slot it stands for, then pulls
+// the line low itself for presence pulses and read slots that answer 0.
+// Standard speed only.
+class OneWireSimPin : public HostPinModel {
+  OneWireSim &sim;
+  bool low = false;
+  unsigned long fell = 0;
+  unsigned long holdFrom = 0;
+  unsigned long holdUntil = 0;
+
+  public:
+    uint32_t badSlots = 0; // lows no slot or reset lasts, see SIM_PIN_*
+    unsigned long longestLow = 0;
+
+    OneWireSimPin(OneWireSim &sim): sim(sim) {}
+
+    void drive(bool pulling);
+    uint8_t level();
+};
+
+#endif // ONEWIRE_SIM_PIN_H_
@@ -0,0 +1,252 @@
+#include "application.h"
+
+static unsigned long long clockMicros = 0;
+static bool interruptsOn = true;
+static unsigned long interruptLatency = 0;
+static bool inInterrupt = false;
+static void (*timerIsr)() = NULL;
+static unsigned long long timerDue = 0;
+static uint8_t pinModes[64];
+static uint8_t pinValues[64];
+static HostPinModel *pinModels[64];
+
+HostSerial Serial;
+
+unsigned long millis() {
+  return clockMicros / 1000;
+}
+
+unsigned long micros() {
+  return clockMicros;
+}
+
+static bool timerPending() {
+  return timerIsr != NULL && interruptsOn && !inInterrupt;
+}
+
+// Runs the timer handler if it's due and can be taken
+static void takeInterrupt() {
+  while (timerPending() && clockMicros >= timerDue) {
+    void (*isr)() = timerIsr;
+
+    timerIsr = NULL;
+    inInterrupt = true;
+    isr();
+    inInterrupt = false;
+  }
+}
+
+// Stops at each timer deadline on the way so the handler runs on time. A
+// handler's own delays come out of the time being waited, unless they
+// outlast it.
+void hostAdvance(unsigned long us) {
+  unsigned long long until = clockMicros + us;
+
+  while (timerPending() && timerDue < until) {
+    if (timerDue > clockMicros) clockMicros = timerDue;
+    takeInterrupt();
+  }
+  if (clockMicros < until) clockMicros = until;
+  takeInterrupt();
+}
+
+void hostTimerArm(unsigned long us, void (*isr)()) {
+  timerIsr = isr;
+  timerDue = clockMicros + us;
+}
+
+void delay(unsigned long ms) {
+  hostAdvance(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  hostAdvance(us);
+}
+
+void noInterrupts() {
+  interruptsOn = false;
+}
+
+// A handler that came due while interrupts were off runs now
+void interrupts() {
+  bool wereOff = !interruptsOn;
+
+  interruptsOn = true;
+  if (wereOff && interruptLatency) hostAdvance(interruptLatency);
+  takeInterrupt();
+}
+
+void hostInterruptLatency(unsigned long us) {
+  interruptLatency = us;
+}
+
+static bool pullingLow(uint16_t pin) {
+  return pinModes[pin] == OUTPUT && pinValues[pin] == LOW;
+}
+
+// Tells the pin's model when the pin starts or stops pulling the line low
+static void changePin(uint16_t pin, uint8_t *setting, uint8_t value) {
+  bool wasLow;
+
+  pin &= 63;
+  wasLow = pullingLow(pin);
+  setting[pin] = value;
+  if (pinModels[pin] != NULL && pullingLow(pin) != wasLow) pinModels[pin]->drive(!wasLow);
+}
+
+void pinMode(uint16_t pin, uint8_t mode) {
+  changePin(pin, pinModes, mode);
+}
+
+void digitalWrite(uint16_t pin, uint8_t value) {
+  changePin(pin, pinValues, value);
+}
+
+int32_t digitalRead(uint16_t pin) {
+  pin &= 63;
+  if (pinModes[pin] == OUTPUT) return pinValues[pin];
+  return pinModels[pin] != NULL ? pinModels[pin]->level() : HIGH;
+}
+
+void hostAttachPin(uint16_t pin, HostPinModel *model) {
+  pinModels[pin & 63] = model;
+}
+
+HostModeRegister::operator uint32_t() const {
+  uint32_t value = 0;
+
+  for (uint8_t i = 0; i < 16; i++) {
+    if (pinModes[base + i] == OUTPUT) value |= 1UL << (2 * i);
+  }
+  return value;
+}
+
+// Every pin changes at the same instant, as with the real register
+HostModeRegister &HostModeRegister::operator=(uint32_t value) {
+  for (uint8_t i = 0; i < 16; i++) {
+    pinMode(base + i, ((value >> (2 * i)) & 3) == 1 ? OUTPUT : INPUT);
+  }
+  return *this;
+}
+
+HostBitRegister &HostBitRegister::operator=(uint16_t bits) {
+  for (uint8_t i = 0; i < 16; i++) {
+    if (bits & (1 << i)) digitalWrite(base + i, value);
+  }
+  return *this;
+}
+
+HostInputRegister::operator uint16_t() const {
+  uint16_t value = 0;
+
+  for (uint8_t i = 0; i < 16; i++) {
+    if (digitalRead(base + i)) value |= 1 << i;
+  }
+  return value;
+}
+
+static GPIO_TypeDef ports[] = { GPIO_TypeDef(0), GPIO_TypeDef(16), GPIO_TypeDef(32), GPIO_TypeDef(48) };
+static STM32_Pin_Info pinMap[64];
+
+STM32_Pin_Info *HAL_Pin_Map() {
+  if (pinMap[0].gpio_peripheral == NULL) {
+    for (uint8_t pin = 0; pin < 64; pin++) {
+      pinMap[pin].gpio_peripheral = &ports[pin / 16];
+      pinMap[pin].gpio_pin = 1 << (pin % 16);
+      pinMap[pin].gpio_pin_source = pin % 16;
+    }
+  }
+  return pinMap;
+}
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  size_t n = 0;
+
+  while (size--) n += write(*buffer++);
+  return n;
+}
+
+size_t Print::printNumber(unsigned long n, uint8_t base) {
+  char buf[8 * sizeof(long) + 1];
+  char *str = &buf[sizeof(buf) - 1];
+
+  if (base < 2) base = 10;
+  *str = '\0';
+  do {
+    unsigned long digit = n % base;
+
+    n /= base;
+    *--str = digit < 10 ? '0' + digit : 'A' + digit - 10;
+  } while (n);
+
+  return write(str);
+}
+
+size_t Print::print(long n, int base) {
+  if (base == DEC && n < 0) {
+    return print('-') + printNumber(-static_cast<unsigned long>(n), DEC);
+  }
+  return printNumber(n, base);
+}
+
+size_t Print::print(double n, int digits) {
+  char buf[32];
+
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return write(buf);
+}
+
+size_t HostSerial::write(uint8_t c) {
+  return fputc(c, stderr) == EOF ? 0 : 1;
+}
+
+void USARTSerial::begin(unsigned long baud) {
+  this->baud = baud;
+}
+
+// Frames still being sent are sent out before it returns
+void USARTSerial::flush() {
+  if (sendingUntil > micros()) hostAdvance(sendingUntil - micros());
+}
+
+size_t USARTSerial::write(uint8_t c) {
+  int echo = line(c, baud);
+
+  if (sendingUntil < micros()) sendingUntil = micros();
+  sendingUntil += 10 * 1000000UL / baud;
+  // A frame that doesn't echo still takes its time on the wire
+  if (echo < 0 || count == BUFFER_SIZE) return 1;
+
+  uint8_t tail = (head + count++) % BUFFER_SIZE;
+  echoes[tail] = echo;
+  due[tail] = sendingUntil;
+  return 1;
+}
+
+// Echoes that are in, from the oldest
+uint8_t USARTSerial::arrived() {
+  uint8_t n = 0;
+
+  while (n < count && due[(head + n) % BUFFER_SIZE] <= micros()) n++;
+  return n;
+}
+
+int USARTSerial::available() {
+  if (count == 0) {
+    hostAdvance(1);
+  } else if (arrived() == 0) {
+    hostAdvance(due[head] - micros());
+  }
+  return arrived();
+}
+
+int USARTSerial::read() {
+  int echo;
+
+  if (arrived() == 0) return -1;
+
+  echo = echoes[head];
+  head = (head + 1) % BUFFER_SIZE;
+  count--;
+  return echo;
+}
@@ -0,0 +1,190 @@
+#ifndef APPLICATION_H_
+#define APPLICATION_H_
+
+// The slice of the Particle firmware API the sensor code uses, for building
+// it on a desktop machine ("host") against OneWireSim. It poses as the
+// firmware's own gcc platform. Time is virtual: it only moves when
+// delay(), delayMicroseconds() or hostAdvance() move it, so tests and
+// benchmarks run as fast as the CPU allows and always come out the same.
+// A timer interrupt handler, see hostTimerArm(), runs in between as the
+// clock passes its deadline. Serial goes to stderr, USARTSerial loops back.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PLATFORM_ID 3 // PLATFORM_GCC
+
+#define TRUE 1
+#define FALSE 0
+#define LOW 0
+#define HIGH 1
+#define INPUT 0
+#define OUTPUT 1
+#define DEC 10
+#define HEX 16
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void noInterrupts();
+void interrupts();
+
+// Moves the virtual clock on, as if the code had been busy that long
+void hostAdvance(unsigned long us);
+
+// Time each interrupts() call loses to the handlers that were held off
+// while interrupts were off, as WiFi and the system tick take on a Photon.
+// Inside the timer handler too, as those can preempt it. 0, the default,
+// for none.
+void hostInterruptLatency(unsigned long us);
+
+// One shot timer, standing in for the hardware timer a driver owns. `isr`
+// runs once `us` have gone by, or later if interrupts are off or another
+// handler is still running then. Arming again replaces the last deadline.
+void hostTimerArm(unsigned long us, void (*isr)());
+
+// What is on the other end of a pin. drive() hears the pin start and stop
+// pulling the line low, level() is what the line reads while the pin
+// isn't driving it.
+class HostPinModel {
+  public:
+    virtual ~HostPinModel() {}
+    virtual void drive(bool low) = 0;
+    virtual uint8_t level() = 0;
+};
+
+// Pins hold whatever was last written; an input reads the line, pulled up
+// unless a model attached with hostAttachPin() says otherwise
+void pinMode(uint16_t pin, uint8_t mode);
+void digitalWrite(uint16_t pin, uint8_t value);
+int32_t digitalRead(uint16_t pin);
+void hostAttachPin(uint16_t pin, HostPinModel *model);
+
+// Just enough of an STM32 GPIO port for drivers that go straight to the
+// registers, see HAL_Pin_Map(). Each register is backed by the host pins,
+// so pin models see the same edges as through pinMode() and digitalWrite().
+// MODER holds 01 for an output and 00 for an input, two bits a pin.
+class HostModeRegister {
+  uint16_t base;
+
+  public:
+    constexpr HostModeRegister(uint16_t base): base(base) {}
+    operator uint32_t() const;
+    HostModeRegister &operator=(uint32_t value);
+    HostModeRegister &operator|=(uint32_t bits) { return *this = *this | bits; }
+    HostModeRegister &operator&=(uint32_t bits) { return *this = *this & bits; }
+};
+
+// Write only: the pins whose bits are set are written `value`
+class HostBitRegister {
+  uint16_t base;
+  uint8_t value;
+
+  public:
+    constexpr HostBitRegister(uint16_t base, uint8_t value): base(base), value(value) {}
+    HostBitRegister &operator=(uint16_t bits);
+};
+
+class HostInputRegister {
+  uint16_t base;
+
+  public:
+    constexpr HostInputRegister(uint16_t base): base(base) {}
+    operator uint16_t() const;
+};
+
+struct GPIO_TypeDef {
+  HostModeRegister MODER;
+  HostInputRegister IDR;
+  HostBitRegister BSRRL;
+  HostBitRegister BSRRH;
+
+  constexpr GPIO_TypeDef(uint16_t base): MODER(base), IDR(base), BSRRL(base, HIGH), BSRRH(base, LOW) {}
+};
+
+struct STM32_Pin_Info {
+  GPIO_TypeDef *gpio_peripheral;
+  uint16_t gpio_pin;
+  uint8_t gpio_pin_source;
+};
+
+// Host pins 0-15 are the 16 pins of the first port, 16-31 of the second
+// and so on
+STM32_Pin_Info *HAL_Pin_Map();
+
+class Print {
+  size_t printNumber(unsigned long n, uint8_t base);
+
+  public:
+    virtual ~Print() {}
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *str) { return write(reinterpret_cast<const uint8_t *>(str), strlen(str)); }
+
+    size_t print(const char str[]) { return write(str); }
+    size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+    size_t print(unsigned char n, int base = DEC) { return print(static_cast<unsigned long>(n), base); }
+    size_t print(int n, int base = DEC) { return print(static_cast<long>(n), base); }
+    size_t print(unsigned int n, int base = DEC) { return print(static_cast<unsigned long>(n), base); }
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC) { return printNumber(n, base); }
+    size_t print(double n, int digits = 2);
+
+    size_t println() { return write("\r\n"); }
+    template<typename T> size_t println(T value) { return print(value) + println(); }
+    template<typename T> size_t println(T value, int format) { return print(value, format) + println(); }
+};
+
+class HostSerial : public Print {
+  public:
+    using Print::write;
+    size_t write(uint8_t c);
+    void begin(unsigned long) {}
+};
+
+extern HostSerial Serial;
+
+// A hardware serial port with TX and RX tied together in half duplex, as
+// OneWireUart wires it. Frames go out back to back at the baud rate and
+// each one's echo reaches RX once its ten bit times are up, as line()
+// leaves it. Waiting on available() for an echo still on the wire moves
+// the virtual clock on to it, and polling an idle port takes a
+// microsecond, so timeouts run out.
+class USARTSerial {
+  static const uint8_t BUFFER_SIZE = 64;
+
+  int16_t echoes[BUFFER_SIZE];
+  unsigned long due[BUFFER_SIZE];
+  uint8_t head = 0;
+  uint8_t count = 0;
+  unsigned long baud = 9600;
+  unsigned long sendingUntil = 0;
+
+  uint8_t arrived();
+
+  public:
+    virtual ~USARTSerial() {}
+
+    void begin(unsigned long baud);
+    void halfduplex(bool) {}
+    void flush();
+    int available();
+    int read();
+    size_t write(uint8_t c);
+    unsigned long baudRate() const { return baud; }
+
+    // What RX reads while `frame` goes out on TX at `baud`, or -1 for no
+    // echo at all. A bare loopback by default.
+    virtual int line(uint8_t frame, unsigned long baud) { return frame; }
+};
+
+#endif // APPLICATION_H_
@@ -1,4 +1,6 @@
 #include "OneWire.h"
+#include "OneWireAsync.h"
+#include "OneWireParallel.h"
 #include "WebServer.h"
 #include "HttpClient.h"
 #include "elapsedMillis.h"
@@ -16,6 +18,7 @@ using namespace std;
 #define WEATHER_INTERVAL 120000
 #define PREFIX ""
 #define WEATHER_ZIP "68522"
+#define HISTORY_PAGE_LINES 500 // about 20KB of CSV
 
 template<class T>
 inline Print &operator <<(Print &obj, T arg){
@@ -29,7 +32,24 @@ elapsedMillis blinkTimeElapsed;
 elapsedMillis powerTimeElapsed;
 elapsedMillis weatherTimeElapsed;
 
+// Define SIMULATED_BUS to run against simulated sensors instead of the
+// probes on D1, e.g. to try driver changes on a bare Photon, or
+// PARALLEL_BUSES for probes on D1 to D4, one bus each, whose scratchpads
+// are read all four at once. Where there's a timer for it the scratchpad
+// reads on D1 alone run in the background, so loop() keeps serving
+// requests while they're on the wire.
+#ifdef SIMULATED_BUS
+#include "OneWireSim.h"
+OneWireSim ds;
+#elif defined(PARALLEL_BUSES) && ONEWIRE_PARALLEL
+const uint16_t busPins[] = { D1, D2, D3, D4 }; // all on GPIOB
+OneWireParallel ds(busPins, 4);
+#elif ONEWIRE_ASYNC
+#define ASYNC_BUS
+OneWireAsync ds(D1);
+#else
 OneWire ds(D1);
+#endif
 Sensors sensors(ds);
 WebServer webserver(PREFIX, 80);
 HttpClient http;
@@ -46,6 +66,10 @@ int led1 = D7;
 int powertail = D5;
 int iotrelay = D6;
 
+// Latest readings in 1/16 C, see FixedTemp.h. The doubles are only for
+// the cloud variables and the heater thresholds.
+RawTemp rawTemperature = RAW_TEMP_INVALID;
+RawTemp rawMinuteAverage = RAW_TEMP_INVALID;
 double temperature;
 double minuteAverage;
 double outdoorTemp;
@@ -65,6 +89,7 @@ STARTUP( startup() );
 void metricsCmd(WebServer &server, WebServer::ConnectionType type, char *, bool){
   server.httpSuccess("text/plain; version=0.0.4");
   if (type != WebServer::HEAD) {
+    char value[16];
     char s_temp[100];
     char s_average_temp[100];
     char s_outdoor_temp[100];
@@ -77,14 +102,25 @@ void metricsCmd(WebServer &server, WebServer::ConnectionType type, char *, bool)
     freemem = System.freeMemory();
 
     server << "# TYPE temp_degrees gauge\n";
-    snprintf(s_temp, 100,"temp_degrees{location=\"garage\",timespan=\"none\"} %.4f %li000\n", temperature, Time.now());
-    snprintf(s_average_temp, 100, "temp_degrees{location=\"garage\",timespan=\"minute\"} %.4f %li000\n", minuteAverage, Time.now());
-    snprintf(s_outdoor_temp, 100, "temp_degrees{location=\"outdoors\",timespan=\"none\"} %.4f %li000\n", outdoorTemp, Time.now());
-    snprintf(s_power_on_temp, 100, "temp_degrees{trigger=\"on\",timespan=\"none\"} %.4f %li000\n", tempOnThreshold, Time.now());
-    snprintf(s_power_off_temp, 100, "temp_degrees{trigger=\"off\",timespan=\"none\"} %.4f %li000\n\n", tempOffThreshold, Time.now());
-
-    server << s_temp;
-    server << s_average_temp;
+    if (rawTemperature != RAW_TEMP_INVALID) {
+      formatFixed(value, sizeof(value), rawToFahrenheit(rawTemperature), 4);
+      snprintf(s_temp, 100,"temp_degrees{location=\"garage\",timespan=\"none\"} %s %li000\n", value, Time.now());
+
+      server << s_temp;
+    }
+    if (rawMinuteAverage != RAW_TEMP_INVALID) {
+      formatFixed(value, sizeof(value), rawToFahrenheit(rawMinuteAverage), 4);
+      snprintf(s_average_temp, 100, "temp_degrees{location=\"garage\",timespan=\"minute\"} %s %li000\n", value, Time.now());
+
+      server << s_average_temp;
+    }
+    formatFixed(value, sizeof(value), static_cast<int32_t>(outdoorTemp * FAHRENHEIT_SCALE), 4);
+    snprintf(s_outdoor_temp, 100, "temp_degrees{location=\"outdoors\",timespan=\"none\"} %s %li000\n", value, Time.now());
+    formatFixed(value, sizeof(value), static_cast<int32_t>(tempOnThreshold * FAHRENHEIT_SCALE), 4);
+    snprintf(s_power_on_temp, 100, "temp_degrees{trigger=\"on\",timespan=\"none\"} %s %li000\n", value, Time.now());
+    formatFixed(value, sizeof(value), static_cast<int32_t>(tempOffThreshold * FAHRENHEIT_SCALE), 4);
+    snprintf(s_power_off_temp, 100, "temp_degrees{trigger=\"off\",timespan=\"none\"} %s %li000\n\n", value, Time.now());
+
     server << s_outdoor_temp;
     server << s_power_on_temp;
     server << s_power_off_temp;
@@ -98,6 +134,65 @@ void metricsCmd(WebServer &server, WebServer::ConnectionType type, char *, bool)
     snprintf(s_freemem, 90, "free_mem_bytes %lu %li000\n\n", freemem, Time.now());
 
     server << s_freemem;
+
+    sensors.metrics(server);
+  }
+}
+
+// Reads the 16 hex digit ROM the history CSV names sensors by
+bool parseRom(const char *hex, byte addr[SENSOR_ADDR_SIZE]) {
+  char digits[3] = { 0, 0, 0 };
+  char *end;
+
+  if (strlen(hex) != 2 * SENSOR_ADDR_SIZE) return false;
+  for (byte i = 0; i < SENSOR_ADDR_SIZE; i++) {
+    digits[0] = hex[2 * i];
+    digits[1] = hex[2 * i + 1];
+    addr[i] = strtoul(digits, &end, 16);
+    if (*end != '\0') return false;
+  }
+  return true;
+}
+
+// Stored samples as CSV, times in unix seconds. /history lists the sensors
+// with history; /history?sensor=<rom>&since=<time>&limit=<n> is one page of
+// a sensor's samples after `since`, at most HISTORY_PAGE_LINES of them.
+// Ask for the next page with `since` set to the last time on this one.
+// Pages keep each request short, the whole history would hold up loop()
+// for seconds.
+void historyCmd(WebServer &server, WebServer::ConnectionType type, char *url_tail, bool){
+  char name[8];
+  char value[20];
+  byte addr[SENSOR_ADDR_SIZE];
+  bool paged = false;
+  uint32_t since = 0;
+  unsigned long limit = HISTORY_PAGE_LINES;
+  int32_t clockOffset = Time.now() - millis() / 1000;
+
+  while (strlen(url_tail)) {
+    if (server.nextURLparam(&url_tail, name, sizeof(name), value, sizeof(value)) == URLPARAM_EOS) break;
+
+    if (strcmp(name, "sensor") == 0) {
+      paged = parseRom(value, addr);
+      if (!paged) {
+        server.httpFail();
+        return;
+      }
+    } else if (strcmp(name, "since") == 0) {
+      since = strtoul(value, NULL, 10);
+    } else if (strcmp(name, "limit") == 0) {
+      limit = strtoul(value, NULL, 10);
+      if (limit > HISTORY_PAGE_LINES) limit = HISTORY_PAGE_LINES;
+    }
+  }
+
+  server.httpSuccess("text/csv");
+  if (type == WebServer::HEAD) return;
+
+  if (paged) {
+    sensors.writeHistory(server, clockOffset, addr, since, limit);
+  } else {
+    sensors.writeHistoryIndex(server, clockOffset);
   }
 }
 
@@ -114,14 +209,30 @@ void setup(void) {
   Particle.function("power", adjustPower);
   Particle.function("setTempOn", setTempOn);
   Particle.function("setTempOff", setTempOff);
+  Particle.function("setRes", setResolution);
+  Particle.function("oversample", setOversample);
+  Particle.function("filter", setFilter);
 
   publishPowerStatus();
 
   webserver.setDefaultCommand(&metricsCmd);
   webserver.addCommand("metrics", &metricsCmd);
+  webserver.addCommand("history", &historyCmd);
   webserver.begin();
 
+#ifdef SIMULATED_BUS
+  ds.addDevice(SIM_DS18B20, 1, 17.5);
+  ds.addDevice(SIM_DS18B20, 2, 18.0);
+  ds.addDevice(SIM_DS18S20, 3, 18.5);
+  ds.addDevice(SIM_DS28EA00, 4, 18.2);
+#endif
+
+#ifdef ASYNC_BUS
+  ds.begin();
+#endif
+
   sensors.scan();
+  sensors.setAlarmWindow(tempOnThreshold, tempOffThreshold);
   sensors.debug();
 }
 
@@ -140,6 +251,7 @@ int setTempOn(String temp) {
   float f_temp = temp.toFloat();
   if(f_temp > 0 && f_temp < tempOffThreshold) {
     tempOnThreshold = f_temp;
+    sensors.setAlarmWindow(tempOnThreshold, tempOffThreshold);
     return 1;
   } else {
     return -1;
@@ -150,12 +262,48 @@ int setTempOff(String temp) {
   float f_temp = temp.toFloat();
   if(f_temp > 0 && f_temp > tempOnThreshold) {
     tempOffThreshold = f_temp;
+    sensors.setAlarmWindow(tempOnThreshold, tempOffThreshold);
     return 1;
   } else {
     return -1;
   }
 }
 
+// Takes the resolution in bits, with a ",save" suffix to also write it to
+// the sensors' EEPROM, e.g. "9" or "12,save".
+int setResolution(String command) {
+  int bits = command.toInt();
+  bool persist = command.endsWith(",save");
+
+  if(bits < 9 || bits > 12) {
+    return -1;
+  }
+  return sensors.setResolution(bits, persist);
+}
+
+int setOversample(String command) {
+  int samples = command.toInt();
+
+  if(samples < 1 || samples > 16) {
+    return -1;
+  }
+  return sensors.setOversample(samples);
+}
+
+// One of "none", "median", "ewma" or "hampel"
+int setFilter(String command) {
+  if(command == "none") {
+    return sensors.setFilter(FILTER_NONE);
+  } else if(command == "median") {
+    return sensors.setFilter(FILTER_MEDIAN);
+  } else if(command == "ewma") {
+    return sensors.setFilter(FILTER_EWMA);
+  } else if(command == "hampel") {
+    return sensors.setFilter(FILTER_HAMPEL);
+  }
+  return -1;
+}
+
 void turnOnPower() {
   if(power != 1) {
     power = 1;
@@ -182,10 +330,11 @@ void publishPowerStatus() {
   }
 }
 
-void publishTemp(const char pLabel[], const char sLabel[], float temp) {
+// `fahrenheit` scaled by FAHRENHEIT_SCALE
+void publishTemp(const char pLabel[], const char sLabel[], int32_t fahrenheit) {
   char publishString[20];
 
-  snprintf(publishString, 20,"%.4f", temp);
+  formatFixed(publishString, 20, fahrenheit, 4);
   Particle.publish(pLabel, publishString);
   Serial.print(sLabel);
   Serial.println(publishString);
@@ -239,7 +388,7 @@ void fetchWeather() {
     f_temp = tempStr.toFloat();
     if (f_temp !=0) {
       outdoorTemp = (double)f_temp;
-      publishTemp("outdoor_temp", "Outdoor Temp: ", outdoorTemp);
+      publishTemp("outdoor_temp", "Outdoor Temp: ", static_cast<int32_t>(f_temp * FAHRENHEIT_SCALE));
     }
   }
 }
@@ -255,7 +404,9 @@ void loop(void) {
     blinkTimeElapsed = 0;
   }
 
-  if (scanTimeElapsed > SCAN_INTERVAL) {
+  // Don't rescan in the middle of an acquisition cycle, it would pull
+  // sensors out from under the reader.
+  if (scanTimeElapsed > SCAN_INTERVAL && !sensors.busy()) {
     scanTimeElapsed = 0;
 
     Serial.println("## Scanning for Sensors");
@@ -269,29 +420,35 @@ void loop(void) {
 
     Serial.println("## Reading Temps");
     if(sensors.count() > 0) {
-      sensors.read();
-
-      minuteAverage = (double)sensors.minute_average;
-      temperature = (double)sensors.temp;
-
-      Serial.print("Temp: ");
-      Serial.println(temperature);
-      Serial.print("Average Temp: ");
-      Serial.println(minuteAverage);
-
-      publishTemp("minute_average", "Average Temp: ", minuteAverage);
-      publishTemp("temperature", "Temp: ", temperature);
+      sensors.start();
     } else {
       Serial.println("No Sensors to Read");
     }
   }
 
+  // With oversampling a cycle can publish a reading while the minute
+  // average is still empty, a failed read drops the partial sample
+  if (sensors.poll() && sensors.temp != RAW_TEMP_INVALID) {
+    rawMinuteAverage = sensors.minute_average;
+    rawTemperature = sensors.temp;
+    temperature = rawToFahrenheit(rawTemperature) / static_cast<double>(FAHRENHEIT_SCALE);
+
+    if (rawMinuteAverage != RAW_TEMP_INVALID) {
+      minuteAverage = rawToFahrenheit(rawMinuteAverage) / static_cast<double>(FAHRENHEIT_SCALE);
+      publishTemp("minute_average", "Average Temp: ", rawToFahrenheit(rawMinuteAverage));
+    }
+    publishTemp("temperature", "Temp: ", rawToFahrenheit(rawTemperature));
+  }
+
   if (powerTimeElapsed > POWER_INTERVAL) {
     powerTimeElapsed = 0;
 
     Serial.println("## Evaluating Power");
 
-    if(minuteAverage > tempOffThreshold) {
+    // No average, no decision: the relay stays as it is
+    if (rawMinuteAverage == RAW_TEMP_INVALID) {
+      Serial.println("No Minute Average");
+    } else if(minuteAverage > tempOffThreshold) {
       turnOffPower();
     } else if(minuteAverage < tempOnThreshold) {
       turnOnPower();
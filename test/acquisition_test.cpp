@@ -0,0 +1,588 @@
+// Sensors::start()/poll() on a simulated bus: one bus wide Convert T per
+// cycle, scratchpads only read once it's done, a cycle that takes about
+// one conversion period however many sensors there are, and the values
+// that come out at the end. Then the control band: cycles that only read
+// the sensors the alarm search turns up, between full reads.
+#include "OneWireSim.h"
+#include "Sensors.h"
+#include "check.h"
+#include <string>
+
+#define CONVERSION_MS 750
+
+// Keeps the function commands that went out on the bus, with when
+struct Command {
+  uint8_t code;
+  uint8_t rom; // first byte after the family code of the selected ROM, 0 for Skip ROM
+  unsigned long at;
+};
+
+class RecordingBus : public OneWireSim {
+  uint8_t romCommand = 0;
+  uint8_t index = 0;
+  uint8_t rom = 0;
+
+  public:
+    Command commands[256];
+    int count = 0;
+    int romCommands[256] = {};
+    unsigned long readBitMicros = 0; // what handlers take from the CPU after each read slot
+
+    uint8_t reset(void) {
+      index = 0;
+      return OneWireSim::reset();
+    }
+
+    void write(uint8_t v, uint8_t power = 0) {
+      if (index == 0) {
+        romCommand = v;
+        romCommands[v]++;
+      }
+      if (romCommand == 0x55 && index == 2) rom = v;
+      if ((romCommand == 0xCC && index == 1) || (romCommand == 0x55 && index == 9)) {
+        Command command = { v, static_cast<uint8_t>(romCommand == 0xCC ? 0 : rom), millis() };
+        if (count < 256) commands[count++] = command;
+      }
+      index++;
+      OneWireSim::write(v, power);
+    }
+
+    uint8_t read_bit(void) {
+      uint8_t bit = OneWireSim::read_bit();
+
+      hostAdvance(readBitMicros);
+      return bit;
+    }
+
+    // Commands since a time, to every sensor or to the one whose ROM
+    // starts with `rom` after the family code
+    int countOf(uint8_t code, unsigned long since, int rom = -1) {
+      int n = 0;
+
+      for (int i = 0; i < count; i++) {
+        if (commands[i].code != code || commands[i].at < since) continue;
+        if (rom < 0 || commands[i].rom == rom) n++;
+      }
+      return n;
+    }
+};
+
+// Runs one acquisition cycle the way loop() does, one poll() a
+// millisecond. Returns how long it took, 0 if it never finished.
+static unsigned long acquire(Sensors &sensors) {
+  unsigned long started = millis();
+
+  sensors.start();
+  while (!sensors.poll()) {
+    delay(1);
+    if (millis() - started > 10 * CONVERSION_MS) return 0;
+  }
+  return millis() - started;
+}
+
+static void addSensors(RecordingBus &bus, int count, bool parasite) {
+  for (int i = 0; i < count; i++) {
+    bus.addDevice(SIM_DS18B20, i + 1, 20.0 + i, parasite);
+  }
+}
+
+// However many sensors there are the cycle takes one conversion, plus a
+// scratchpad read each. Converting one sensor after the other, as before,
+// took 900ms a sensor.
+static void testOneConversionPerCycle() {
+  for (int count = 1; count <= MAX_SENSORS; count += MAX_SENSORS - 1) {
+    static RecordingBus bus;
+    bus = RecordingBus();
+    Sensors sensors(bus);
+    addSensors(bus, count, false);
+    sensors.scan();
+    CHECK_EQ(sensors.count(), count);
+
+    unsigned long started = millis();
+    bus.resetBusMicros();
+    unsigned long took = acquire(sensors);
+    unsigned long wire = bus.busMicros() / 1000;
+
+    // The virtual clock doesn't move for bus traffic, so add the time it
+    // would take on the wire: about 12ms a scratchpad read, and 50ms of
+    // ready bit polls through the conversion
+    CHECK(took >= CONVERSION_MS && took < CONVERSION_MS + 2 * count + 5);
+    CHECK(took + wire < CONVERSION_MS + 15 * count + 75);
+    CHECK_EQ(bus.countOf(0x44, started), 1);
+    CHECK_EQ(bus.countOf(0xBE, started), count);
+
+    // Convert T went to every sensor at once, and nothing was read back
+    // before the conversion finished
+    for (int i = 0; i < bus.count; i++) {
+      Command &command = bus.commands[i];
+
+      if (command.at < started) continue;
+      if (command.code == 0x44) CHECK_EQ(command.rom, 0);
+      if (command.code == 0xBE) CHECK(command.at - started >= CONVERSION_MS);
+    }
+
+    // The mean of the latest readings, 20.0 C up in 1 C steps
+    int32_t sum = 0;
+    for (int i = 0; i < count; i++) sum += (20 + i) * 16;
+    CHECK_EQ(sensors.temp, divRound(sum, count));
+    CHECK_EQ(sensors.minute_average, sensors.temp);
+  }
+}
+
+// Parasite powered sensors can't signal the end of the conversion, so the
+// cycle runs to the datasheet worst case
+static void testParasiteWaitsOutTheConversion() {
+  static RecordingBus bus;
+  Sensors sensors(bus);
+
+  addSensors(bus, 3, true);
+  sensors.scan();
+
+  unsigned long took = acquire(sensors);
+  CHECK(took >= CONVERSION_MS && took < CONVERSION_MS + 10);
+  CHECK_EQ(sensors.temp, 21 * 16);
+}
+
+// A sensor that drops off mid cycle doesn't hold the others up: its read
+// times out through the retries and the rest still get published
+static void testMissingSensor() {
+  static RecordingBus bus;
+  Sensors sensors(bus);
+
+  addSensors(bus, 3, false);
+  sensors.scan();
+  CHECK(acquire(sensors) > 0);
+
+  bus.setTemperature(0, 25.0);
+  bus.setTemperature(2, 27.0);
+  bus.setPresent(1, false);
+  unsigned long started = millis();
+  unsigned long took = acquire(sensors);
+
+  CHECK(took > 0 && took < CONVERSION_MS + 50);
+  CHECK_EQ(bus.countOf(0xBE, started), 2 + 1 + READ_RETRIES);
+
+  // sensor 1 keeps its last reading, the others have the new ones
+  CHECK_EQ(sensors.temp, divRound((25 + 21 + 27) * 16, 3));
+}
+
+// Nothing is published until the cycle is over, and only once
+static void testPublishesOnce() {
+  static RecordingBus bus;
+  Sensors sensors(bus);
+  int published = 0;
+
+  addSensors(bus, 2, false);
+  sensors.scan();
+  CHECK(!sensors.poll());
+
+  sensors.start();
+  CHECK(sensors.busy());
+  for (int ms = 0; ms < 2 * CONVERSION_MS; ms++) {
+    if (sensors.poll()) published++;
+    delay(1);
+  }
+  CHECK_EQ(published, 1);
+  CHECK(!sensors.busy());
+}
+
+// With oversampling a read that fails part way through a cycle drops the
+// readings the cycle already took, rather than averaging them into the
+// next cycle's sample
+static void testFailedReadDropsPartialSample() {
+  static RecordingBus bus;
+  Sensors sensors(bus);
+  unsigned long started;
+
+  addSensors(bus, 1, false);
+  sensors.scan();
+  sensors.setOversample(2);
+
+  // the first conversion reads fine, the second one doesn't
+  started = millis();
+  sensors.start();
+  while (bus.countOf(0xBE, started) == 0) {
+    sensors.poll();
+    delay(1);
+  }
+  bus.setPresent(0, false);
+  while (!sensors.poll()) delay(1);
+  CHECK_EQ(sensors.minute_average, RAW_TEMP_INVALID);
+
+  bus.setPresent(0, true);
+  bus.setTemperature(0, 30.0);
+  CHECK(acquire(sensors) > 0);
+  CHECK_EQ(sensors.minute_average, 30 * 16);
+}
+
+// A sensor whose quarantine runs out part way through a cycle it sat out
+// isn't read that cycle: on a bus converting one sensor at a time it
+// hasn't converted, and would hand back a stale scratchpad
+static void testQuarantineEndsBetweenCycles() {
+  static RecordingBus bus;
+  Sensors sensors(bus);
+  unsigned long quarantined;
+  unsigned long started;
+
+  addSensors(bus, PARASITE_MAX_CONVERSIONS + 1, true);
+  sensors.scan();
+  CHECK(acquire(sensors) > 0);
+
+  bus.setPresent(0, false);
+  for (int i = 0; i < QUARANTINE_AFTER; i++) CHECK(acquire(sensors) > 0);
+  quarantined = millis();
+  bus.setPresent(0, true);
+  bus.setTemperature(0, 40.0);
+
+  // starts just before the quarantine is up, the reads come just after
+  delay(QUARANTINE_MIN_MS - CONVERSION_MS);
+  started = millis();
+  CHECK(acquire(sensors) > 0);
+  CHECK(millis() > quarantined + QUARANTINE_MIN_MS);
+  CHECK_EQ(bus.countOf(0x44, started, 1), 0);
+  CHECK_EQ(bus.countOf(0xBE, started, 1), 0);
+
+  started = millis();
+  CHECK(acquire(sensors) > 0);
+  CHECK_EQ(bus.countOf(0x44, started, 1), 1);
+  CHECK_EQ(bus.countOf(0xBE, started, 1), 1);
+  CHECK_EQ(sensors.temp, divRound((40 + 21 + 22 + 23 + 24) * 16, 5));
+}
+
+// Runs start() and poll() the way loop() does for `ms` of virtual time,
+// starting a cycle every `every` ms. Returns how many cycles published.
+static int runFor(Sensors &sensors, unsigned long ms, unsigned long every) {
+  int published = 0;
+
+  for (unsigned long t = 0; t < ms; t++) {
+    if (t % every == 0) sensors.start();
+    if (sensors.poll()) published++;
+    delay(1);
+  }
+  return published;
+}
+
+// Cycles that read nothing don't publish, and a quarantined sensor doesn't
+// count as due, so while it's the only one the bus is left alone
+static void testNothingReadNothingPublished() {
+  static RecordingBus bus;
+  Sensors sensors(bus);
+  unsigned long started;
+
+  addSensors(bus, 1, false);
+  sensors.scan();
+  CHECK(acquire(sensors) > 0);
+
+  bus.setPresent(0, false);
+  CHECK_EQ(runFor(sensors, QUARANTINE_AFTER * 2 * CONVERSION_MS, 2 * CONVERSION_MS), 0);
+
+  started = millis();
+  CHECK_EQ(runFor(sensors, QUARANTINE_MIN_MS - 2 * CONVERSION_MS, 2 * CONVERSION_MS), 0);
+  CHECK_EQ(bus.countOf(0x44, started), 0);
+  CHECK_EQ(bus.countOf(0xBE, started), 0);
+
+  // once it's back it publishes again
+  bus.setPresent(0, true);
+  CHECK_EQ(runFor(sensors, 4 * CONVERSION_MS, 2 * CONVERSION_MS), 1);
+}
+
+// A rescan only takes the Read ROM shortcut when the sensor is the only
+// device on the bus. Anything else answering would garble the ROM and
+// force a full search every time.
+static void testRescanWithOtherDevices() {
+  for (int others = 0; others <= 1; others++) {
+    static RecordingBus bus;
+    bus = RecordingBus();
+    Sensors sensors(bus);
+
+    addSensors(bus, 1, false);
+    if (others) {
+      // an ID only device, family 0x01 like a DS2401
+      SimDevice &device = bus.device(bus.addDevice(SIM_DS18B20, 0x100, 20.0));
+      device.rom[0] = 0x01;
+      device.rom[7] = OneWire::crc8(device.rom, 7);
+    }
+    sensors.scan();
+    CHECK_EQ(sensors.count(), 1);
+
+    bus.romCommands[0x33] = 0;
+    bus.romCommands[0xF0] = 0;
+    sensors.scan();
+    CHECK_EQ(sensors.count(), 1);
+    // a lone sensor answers Read ROM, otherwise it's one forced search pass
+    CHECK_EQ(bus.romCommands[0x33], others ? 0 : 1);
+    CHECK_EQ(bus.romCommands[0xF0], others ? 1 : 0);
+  }
+}
+
+// One bad conversion doesn't reach the minute average, the Hampel filter
+// swaps it for the median on the way into the window
+static void testSpikeIsFiltered() {
+  static RecordingBus bus;
+  Sensors sensors(bus);
+  unsigned long started;
+
+  addSensors(bus, 1, false);
+  bus.setTemperature(0, 18.0);
+  sensors.scan();
+  for (int i = 0; i < 3; i++) CHECK(acquire(sensors) > 0);
+
+  bus.setTemperature(0, 45.0);
+  started = millis();
+  CHECK(acquire(sensors) > 0);
+  CHECK_EQ(bus.countOf(0xBE, started), 1);
+  CHECK_EQ(sensors.temp, 45 * 16);
+  CHECK_EQ(sensors.minute_average, 18 * 16);
+
+  bus.setTemperature(0, 18.0);
+  CHECK(acquire(sensors) > 0);
+  CHECK_EQ(sensors.minute_average, 18 * 16);
+}
+
+// Runs one acquisition cycle through to idle, whether it publishes or not
+static void runCycle(Sensors &sensors) {
+  unsigned long started = millis();
+
+  sensors.start();
+  while (sensors.busy() && millis() - started < 10 * CONVERSION_MS) {
+    sensors.poll();
+    delay(1);
+  }
+  CHECK(!sensors.busy());
+}
+
+// Runs a control only cycle and checks it searched for alarms, then read
+// just the sensor whose ROM starts with `alarmed` after the family code,
+// or nothing if it's 0
+static void checkControlOnly(RecordingBus &bus, Sensors &sensors, int alarmed) {
+  int searches = bus.romCommands[0xEC];
+  unsigned long started = millis();
+
+  runCycle(sensors);
+  CHECK(bus.romCommands[0xEC] > searches);
+  CHECK_EQ(bus.countOf(0x44, started), 1);
+  CHECK_EQ(bus.countOf(0xBE, started), alarmed ? 1 : 0);
+  if (alarmed) CHECK_EQ(bus.countOf(0xBE, started, alarmed), 1);
+}
+
+// Once the band is set, the cycle that programs TH/TL reads everything,
+// the next FULL_READ_EVERY - 1 only read what the alarm search finds, and
+// then there's a full read again
+static void testControlOnlyCycles() {
+  static RecordingBus bus;
+  Sensors sensors(bus);
+  unsigned long started;
+
+  addSensors(bus, 3, false); // 20, 21 and 22 C
+  sensors.scan();
+  sensors.setAlarmWindow(60.0, 75.0); // alarms at 15 C and below, 23 C and above
+
+  started = millis();
+  runCycle(sensors);
+  CHECK_EQ(bus.countOf(0x4E, started), 3);
+  CHECK_EQ(bus.countOf(0xBE, started + 1), 3); // past the reads setAlarm() does
+  CHECK_EQ(bus.romCommands[0xEC], 0);
+  for (int i = 0; i < 3; i++) {
+    CHECK_EQ(bus.device(i).scratchpad[2], 23);
+    CHECK_EQ(bus.device(i).scratchpad[3], 15);
+  }
+
+  checkControlOnly(bus, sensors, 0);
+  bus.setTemperature(1, 30.0);
+  checkControlOnly(bus, sensors, 2);
+  CHECK_EQ(sensors.temp, divRound((20 + 30 + 22) * 16, 3));
+  bus.setTemperature(1, 14.0);
+  checkControlOnly(bus, sensors, 2);
+  // back in the band it's left alone until the full read
+  bus.setTemperature(1, 21.0);
+  checkControlOnly(bus, sensors, 0);
+  checkControlOnly(bus, sensors, 0);
+
+  int searches = bus.romCommands[0xEC];
+  started = millis();
+  runCycle(sensors);
+  CHECK_EQ(bus.romCommands[0xEC], searches);
+  CHECK_EQ(bus.countOf(0xBE, started), 3);
+  CHECK_EQ(bus.countOf(0x4E, started), 0);
+}
+
+// Moving the band rewrites TH/TL on the next cycle, which is a full read,
+// and the alarm search after it goes by the new band
+static void testBandChangeRearms() {
+  static RecordingBus bus;
+  Sensors sensors(bus);
+  unsigned long started;
+
+  addSensors(bus, 3, false);
+  sensors.scan();
+  sensors.setAlarmWindow(60.0, 75.0);
+  runCycle(sensors);
+  checkControlOnly(bus, sensors, 0);
+
+  sensors.setAlarmWindow(50.0, 70.0); // 10 C and 21 C
+  int searches = bus.romCommands[0xEC];
+  started = millis();
+  runCycle(sensors);
+  CHECK_EQ(bus.countOf(0x4E, started), 3);
+  CHECK_EQ(bus.countOf(0xBE, started + 1), 3);
+  CHECK_EQ(bus.romCommands[0xEC], searches);
+  for (int i = 0; i < 3; i++) {
+    CHECK_EQ(bus.device(i).scratchpad[2], 21);
+    CHECK_EQ(bus.device(i).scratchpad[3], 10);
+  }
+
+  // 21 and 22 C are at or over the new top
+  started = millis();
+  runCycle(sensors);
+  CHECK_EQ(bus.countOf(0xBE, started), 2);
+  CHECK_EQ(bus.countOf(0xBE, started, 1), 0);
+}
+
+// The ready bit polls can take long enough for the conversion to finish
+// partway through poll(). Deciding between the alarm search and a read
+// on a second look at conversionDone() then skipped the search, and the
+// alarmed sensor wasn't read.
+static void testAlarmSearchAfterSlowConversion() {
+  static RecordingBus bus;
+  Sensors sensors(bus);
+
+  addSensors(bus, 3, false);
+  sensors.scan();
+  sensors.setAlarmWindow(60.0, 75.0);
+  runCycle(sensors);
+
+  // A few poll periods, so one of them has a poll land just short of the
+  // end of the conversion
+  bus.setTemperature(0, 30.0);
+  for (int cycle = 1; cycle < FULL_READ_EVERY; cycle++) {
+    bus.readBitMicros = 1500 + 300 * cycle;
+    checkControlOnly(bus, sensors, 1);
+  }
+}
+
+class Capture : public Print {
+  public:
+    std::string text;
+
+    using Print::write;
+    size_t write(uint8_t c) {
+      text += static_cast<char>(c);
+      return 1;
+    }
+};
+
+// Four buses of MAX_SENSORS each all make it into the table and into the
+// reading. Devices past MAX_SENSORS on a bus are counted, not kept.
+static void testFourFullBuses() {
+  static OneWireSim lanes[MAX_BUSES];
+  OneWire *buses[MAX_BUSES];
+
+  for (int bus = 0; bus < MAX_BUSES; bus++) {
+    for (int i = 0; i < MAX_SENSORS; i++) {
+      lanes[bus].addDevice(SIM_DS18B20, 100 * (bus + 1) + i, 20.0 + bus);
+    }
+    buses[bus] = &lanes[bus];
+  }
+  // The search keeps whichever come first in ROM order, so these read the
+  // same as the rest of their bus
+  lanes[2].addDevice(SIM_DS18B20, 900, 22.0);
+  lanes[2].addDevice(SIM_DS18B20, 901, 22.0);
+
+  Sensors sensors(buses, MAX_BUSES);
+  sensors.scan();
+  CHECK_EQ(sensors.count(), MAX_BUSES * MAX_SENSORS);
+  CHECK(acquire(sensors) > 0);
+  // 20, 21, 22 and 23 C
+  CHECK_EQ(sensors.temp, divRound(16 * (20 + 21 + 22 + 23), 4));
+
+  Capture metrics;
+  sensors.metrics(metrics);
+  CHECK(metrics.text.find("onewire_dropped_devices_total{bus=\"2\"} 2\n") != std::string::npos);
+  CHECK(metrics.text.find("onewire_dropped_devices_total{bus=\"0\"} 0\n") != std::string::npos);
+  CHECK(metrics.text.find("onewire_skipped_cycles_total 0\n") != std::string::npos);
+  CHECK(metrics.text.find("onewire_conversion_wait_seconds_count{} 1\n") != std::string::npos);
+  CHECK(metrics.text.find("onewire_search_seconds_count{bus=\"3\"} 1\n") != std::string::npos);
+}
+
+// The value on the first /metrics line starting with `name`
+static long metricValue(Sensors &sensors, const char *name) {
+  Capture metrics;
+  size_t line;
+
+  sensors.metrics(metrics);
+  line = metrics.text.find(std::string("\n") + name);
+  if (line == std::string::npos) return -1;
+  return atol(metrics.text.c_str() + metrics.text.find(' ', line) + 1);
+}
+
+// Runs `cycles` acquisition cycles, an R for each that read a scratchpad
+// and a . for each that didn't
+static std::string readPattern(RecordingBus &bus, Sensors &sensors, int cycles) {
+  std::string pattern;
+
+  for (int i = 0; i < cycles; i++) {
+    unsigned long started = millis();
+
+    runCycle(sensors);
+    pattern += bus.countOf(0xBE, started) ? 'R' : '.';
+  }
+  return pattern;
+}
+
+// A steady sensor is read every cycle until its window fills, then every
+// 2, 4 and SAMPLE_INTERVAL_MAX cycles. Cycles with nothing due leave the
+// bus alone and are counted. A jump of more than SAMPLE_STEP puts it back
+// to every cycle at its next read.
+static void testIntervalBacksOff() {
+  static RecordingBus bus;
+  Sensors sensors(bus);
+
+  addSensors(bus, 1, false);
+  sensors.scan();
+
+  CHECK(readPattern(bus, sensors, 28) == "RRRRRR.R...R.......R.......R");
+  CHECK_EQ(metricValue(sensors, "onewire_sensor_sample_interval_cycles"), SAMPLE_INTERVAL_MAX);
+  CHECK_EQ(metricValue(sensors, "onewire_skipped_cycles_total"), 18);
+
+  bus.setTemperature(0, 20.0 + 3 * 0.0625);
+  CHECK(readPattern(bus, sensors, 8) == ".......R");
+  CHECK_EQ(metricValue(sensors, "onewire_sensor_sample_interval_cycles"), 1);
+  CHECK(readPattern(bus, sensors, 1) == "R");
+  CHECK_EQ(metricValue(sensors, "onewire_skipped_cycles_total"), 25);
+}
+
+// With the minute average within SAMPLE_GUARD of the control band every
+// sensor is read every cycle, however steady. A DS2438 has no alarm, so
+// it's read whenever it's due, between full reads too.
+static void testGuardForcesReads() {
+  static RecordingBus bus;
+  Sensors sensors(bus);
+
+  bus.addDevice(SIM_DS2438, 1, 20.0);
+  sensors.scan();
+  sensors.setAlarmWindow(60.0, 75.0); // 15.6 C to 23.9 C, well clear
+  CHECK(readPattern(bus, sensors, 20) == "RRRRRR.R...R.......R");
+
+  sensors.setAlarmWindow(67.0, 80.0); // 19.4 C, 20 C is in the guard
+  CHECK(readPattern(bus, sensors, 16) == ".......RRRRRRRRR");
+  CHECK_EQ(metricValue(sensors, "onewire_sensor_sample_interval_cycles"), 1);
+}
+
+int main() {
+  testOneConversionPerCycle();
+  testParasiteWaitsOutTheConversion();
+  testMissingSensor();
+  testPublishesOnce();
+  testFailedReadDropsPartialSample();
+  testQuarantineEndsBetweenCycles();
+  testNothingReadNothingPublished();
+  testRescanWithOtherDevices();
+  testSpikeIsFiltered();
+  testFourFullBuses();
+  testControlOnlyCycles();
+  testBandChangeRearms();
+  testAlarmSearchAfterSlowConversion();
+  testIntervalBacksOff();
+  testGuardForcesReads();
+  return checkResult();
+}
@@ -0,0 +1,199 @@
+// OneWireAsync on a pin wired to simulated devices, its slots timed by the
+// host's virtual timer: queued transactions come back right, the slots it
+// puts on the wire are in spec, and Sensors reads through it without
+// poll() ever waiting on the bus.
+#include "OneWireAsync.h"
+#include "OneWireSimPin.h"
+#include "Sensors.h"
+#include "check.h"
+
+#define ASYNC_PIN 2
+#define BLOCKING_PIN 3
+// Enough to stretch a 0 past 120us, or push the presence sample past the
+// end of the presence pulse, if either were left to the timer
+#define LATENCY_US 70
+
+static OneWireSim sim;
+static OneWireSimPin wire(sim);
+static OneWireAsync async(ASYNC_PIN);
+
+// The same devices behind a plain blocking OneWire, for comparison
+static OneWireSim blockingSim;
+static OneWireSimPin blockingWire(blockingSim);
+static OneWire blocking(BLOCKING_PIN);
+
+static void addSensors(OneWireSim &bus) {
+  for (int i = 0; i < 3; i++) {
+    bus.addDevice(SIM_DS18B20, i + 1, 20.0 + i);
+  }
+}
+
+// Runs one acquisition cycle the way loop() does, one poll() a
+// millisecond. Returns the longest a poll() took, in microseconds.
+static unsigned long acquire(Sensors &sensors) {
+  unsigned long longest = 0;
+  unsigned long started = millis();
+
+  sensors.start();
+  while (sensors.busy() && millis() - started < 2000) {
+    unsigned long polled = micros();
+
+    sensors.poll();
+    if (micros() - polled > longest) longest = micros() - polled;
+    delay(1);
+  }
+  CHECK(!sensors.busy());
+  return longest;
+}
+
+// The pin adapter itself, under the driver the async one is compared with
+static void testBlockingDriver() {
+  byte addr[8];
+  int found = 0;
+
+  CHECK(blocking.reset());
+  blocking.reset_search();
+  while (blocking.search(addr)) {
+    bool known = false;
+
+    for (int i = 0; i < 3; i++) {
+      if (memcmp(addr, blockingSim.device(i).rom, 8) == 0) known = true;
+    }
+    CHECK(known);
+    found++;
+  }
+  CHECK_EQ(found, 3);
+  CHECK_EQ(blockingWire.badSlots, 0);
+}
+
+// A scratchpad read goes out in the background and the results come back
+// in order, while the main loop keeps getting the CPU between slots
+static void testQueuedRead() {
+  uint8_t value;
+  uint8_t scratchpad[9];
+  int loops = 0;
+  unsigned long started = micros();
+
+  CHECK(async.queueReset());
+  CHECK(async.queueSelect(sim.device(1).rom));
+  CHECK(async.queueWrite(0xBE));
+  CHECK(async.queueRead(9));
+  CHECK(!async.idle());
+
+  // A reset, 11 bytes written and 9 read take about 12ms on the wire.
+  // The handler has the CPU from each falling edge to the release, the
+  // main loop gets the reset low and the recovery times, over half of it.
+  while (!async.idle()) {
+    hostAdvance(10);
+    loops++;
+  }
+  CHECK(micros() - started > 11000);
+  CHECK(loops * 10UL > (micros() - started) / 2);
+
+  CHECK(async.result(value));
+  CHECK_EQ(value, 1);
+  for (int i = 0; i < 9; i++) CHECK(async.result(scratchpad[i]));
+  CHECK(memcmp(scratchpad, sim.device(1).scratchpad, 9) == 0);
+  CHECK(!async.result(value));
+  CHECK_EQ(wire.badSlots, 0);
+
+  // nothing answers a reset on a bus with nobody left on it
+  for (int i = 0; i < 3; i++) sim.setPresent(i, false);
+  CHECK(async.queueReset());
+  while (!async.idle()) hostAdvance(10);
+  CHECK(async.result(value));
+  CHECK_EQ(value, 0);
+  for (int i = 0; i < 3; i++) sim.setPresent(i, true);
+}
+
+// Handlers that preempt the timer's own, or hold it up, can only eat into
+// the time between slots: the zeros stay in spec, presence is still seen
+// and the bytes come back right
+static void testInterruptLatency() {
+  static const uint8_t zeros[] = { 0x00, 0x00, 0x80, 0x01 };
+  uint8_t value;
+  uint8_t scratchpad[9];
+
+  hostInterruptLatency(LATENCY_US);
+  wire.badSlots = 0;
+
+  CHECK(async.queueReset());
+  CHECK(async.queueWriteBytes(zeros, sizeof(zeros)));
+  CHECK(async.queueReset());
+  CHECK(async.queueSelect(sim.device(2).rom));
+  CHECK(async.queueWrite(0xBE));
+  CHECK(async.queueRead(9));
+  while (!async.idle()) hostAdvance(10);
+
+  for (int i = 0; i < 2; i++) {
+    CHECK(async.result(value));
+    CHECK_EQ(value, 1);
+  }
+  for (int i = 0; i < 9; i++) CHECK(async.result(scratchpad[i]));
+  CHECK(memcmp(scratchpad, sim.device(2).scratchpad, 9) == 0);
+  CHECK_EQ(wire.badSlots, 0);
+
+  hostInterruptLatency(0);
+}
+
+// The same cycle through both drivers reads the same values, but only the
+// blocking one holds poll() up for a whole scratchpad read
+static void testSensorsReadInBackground() {
+  static Sensors sensors(async);
+  static Sensors blockingSensors(blocking);
+  unsigned long longest;
+
+  sensors.scan();
+  blockingSensors.scan();
+  CHECK_EQ(sensors.count(), 3);
+
+  longest = acquire(sensors);
+  CHECK_EQ(sensors.temp, 21 * 16);
+  CHECK(longest < 200);
+  CHECK_EQ(wire.badSlots, 0);
+
+  longest = acquire(blockingSensors);
+  CHECK_EQ(blockingSensors.temp, 21 * 16);
+  CHECK(longest > 5000);
+
+  // a garbled read is queued again, and one from a sensor that's gone
+  // runs out of retries without holding the others up
+  sim.setTemperature(0, 25.0);
+  sim.setTemperature(2, 27.0);
+  sim.corruptNextReads(0, 1);
+  sim.setPresent(1, false);
+  acquire(sensors);
+  CHECK_EQ(sim.device(0).corruptReads, 0);
+  CHECK_EQ(sensors.temp, divRound((25 + 21 + 27) * 16, 3));
+  CHECK(async.idle());
+  sim.setPresent(1, true);
+}
+
+// A DS2438's read queues Recall Memory ahead of it, so its first reading
+// is the conversion just done, not its power on scratchpad
+static void testQueuedRecall() {
+  static Sensors sensors(async);
+
+  sim.addDevice(SIM_DS2438, 4, 24.0);
+  sensors.scan();
+  CHECK_EQ(sensors.count(), 4);
+
+  acquire(sensors);
+  CHECK_EQ(sensors.temp, divRound((25 + 21 + 27 + 24) * 16, 4));
+  CHECK_EQ(wire.badSlots, 0);
+}
+
+int main() {
+  hostAttachPin(ASYNC_PIN, &wire);
+  hostAttachPin(BLOCKING_PIN, &blockingWire);
+  addSensors(sim);
+  addSensors(blockingSim);
+  async.begin();
+
+  testBlockingDriver();
+  testQueuedRead();
+  testInterruptLatency();
+  testSensorsReadInBackground();
+  testQueuedRecall();
+  return checkResult();
+}
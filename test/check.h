@@ -0,0 +1,31 @@
+#ifndef CHECK_H_
+#define CHECK_H_
+
+#include <stdio.h>
+
+// Just enough of a test harness for the host tests: failed checks are
+// reported and counted, and checkResult() turns the count into the exit
+// status ctest looks at.
+static int checkFailures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+      checkFailures++; \
+      fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+    } \
+  } while (0)
+
+#define CHECK_EQ(actual, expected) do { \
+    long long a_ = (actual), e_ = (expected); \
+    if (a_ != e_) { \
+      checkFailures++; \
+      fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, a_, e_); \
+    } \
+  } while (0)
+
+inline int checkResult() {
+  if (checkFailures) fprintf(stderr, "%d check(s) failed\n", checkFailures);
+  return checkFailures ? 1 : 0;
+}
+
+#endif // CHECK_H_
@@ -0,0 +1,225 @@
+// Scratchpad decoding for each family against the example readings in the
+// datasheets, with the frames played back by a bus that doesn't model any
+// device, so a decoding and a simulator bug can't cancel out. Then the
+// DS2438 on the simulated bus, which only has a reading to give once it's
+// been told to recall it.
+#include "ChipFamily.h"
+#include "OneWireSim.h"
+#include "Sensor.h"
+#include "check.h"
+
+// Hands back a canned scratchpad and keeps what was written
+class ReplayBus : public OneWire {
+  const uint8_t *frame = NULL;
+  uint8_t next = 0;
+
+  public:
+    uint8_t written[4];
+    uint8_t writes = 0;
+
+    void play(const uint8_t *data) {
+      frame = data;
+      next = 0;
+      writes = 0;
+    }
+
+    uint8_t reset(void) { return 1; }
+    void write(uint8_t v, uint8_t = 0) {
+      if (writes < sizeof(written)) written[writes] = v;
+      writes++;
+    }
+    uint8_t read(void) { return frame[next++]; }
+    uint8_t read_bit(void) { return 1; }
+    void write_bit(uint8_t) {}
+    void depower(void) {}
+};
+
+static ReplayBus bus;
+
+// Decodes a scratchpad of the family with this code, filling in the CRC
+// first unless `badCrc`. The command and decode halves a queued read uses
+// have to come to the same thing as the blocking reader.
+static bool decode(byte code, uint8_t data[SCRATCHPAD_SIZE], Scratchpad &scratchpad, bool badCrc = false) {
+  const ChipFamily *family = findChipFamily(code);
+  byte command[SCRATCHPAD_COMMAND_SIZE];
+  Scratchpad queued;
+  bool valid;
+
+  data[family->scratchpadLength - 1] = OneWire::crc8(data, family->scratchpadLength - 1) ^ (badCrc ? 1 : 0);
+  bus.play(data);
+  valid = family->read(bus, scratchpad);
+
+  CHECK_EQ(family->command(command), bus.writes);
+  CHECK(memcmp(command, bus.written, bus.writes) == 0);
+  memcpy(queued.data, data, SCRATCHPAD_SIZE);
+  CHECK_EQ(family->decode(queued), valid);
+  if (valid) CHECK_EQ(queued.raw, scratchpad.raw);
+
+  return valid;
+}
+
+// DS18B20 and DS28EA00: the low bits are undefined below 12 bits, and the
+// reading truncates towards minus infinity like the sensor does
+static void testConfigurableResolution(byte code) {
+  static const byte configs[] = { 0x1F, 0x3F, 0x5F, 0x7F };
+  static const struct { uint8_t lsb, msb; RawTemp raw[4]; } readings[] = {
+    { 0xD0, 0x07, { 2000, 2000, 2000, 2000 } },   // +125
+    { 0x50, 0x05, { 1360, 1360, 1360, 1360 } },   // +85, the power on value
+    { 0x97, 0x01, { 400, 404, 406, 407 } },       // +25.4375
+    { 0xA2, 0x00, { 160, 160, 162, 162 } },       // +10.125
+    { 0x08, 0x00, { 8, 8, 8, 8 } },               // +0.5
+    { 0x00, 0x00, { 0, 0, 0, 0 } },
+    { 0xF8, 0xFF, { -8, -8, -8, -8 } },           // -0.5
+    { 0x6F, 0xFE, { -408, -404, -402, -401 } },   // -25.0625
+    { 0x90, 0xFC, { -880, -880, -880, -880 } }    // -55
+  };
+  const ChipFamily *family = findChipFamily(code);
+  Scratchpad scratchpad;
+
+  CHECK(family->configurable && family->alarm);
+  for (byte bits = 9; bits <= 12; bits++) {
+    for (const auto &reading : readings) {
+      uint8_t data[SCRATCHPAD_SIZE] = { reading.lsb, reading.msb, 0x4B, 0x46, configs[bits - 9], 0xFF, 0x0C, 0x10 };
+
+      CHECK(decode(code, data, scratchpad));
+      CHECK_EQ(scratchpad.resolution, bits);
+      CHECK_EQ(scratchpad.raw, reading.raw[bits - 9]);
+    }
+  }
+  CHECK_EQ(bus.written[0], 0xBE);
+  CHECK_EQ(bus.writes, 1);
+
+  CHECK_EQ(family->conversionTime(9), CONVERSION_TIME_9_BIT);
+  CHECK_EQ(family->conversionTime(10), CONVERSION_TIME_10_BIT);
+  CHECK_EQ(family->conversionTime(11), CONVERSION_TIME_11_BIT);
+  CHECK_EQ(family->conversionTime(12), CONVERSION_TIME_12_BIT);
+
+  // the fixed bits of the config register
+  uint8_t badConfig[SCRATCHPAD_SIZE] = { 0x91, 0x01, 0x4B, 0x46, 0xFF, 0xFF, 0x0C, 0x10 };
+  CHECK(!decode(code, badConfig, scratchpad));
+}
+
+// 1/2 C steps, extended to 1/16 C by TEMP_READ - 0.25 + (16 - COUNT_REMAIN) / 16
+static void testDS18S20() {
+  static const struct { uint8_t lsb, msb, countRemain; RawTemp raw; } readings[] = {
+    { 0xAA, 0x00, 0x0C, 1360 },  // +85, the power on value
+    { 0x32, 0x00, 0x0C, 400 },   // +25
+    { 0x32, 0x00, 0x05, 407 },   // +25.4375
+    { 0x33, 0x00, 0x05, 407 },   // the half degree bit is dropped
+    { 0x01, 0x00, 0x0C, 0 },     // +0.5, truncated to 0
+    { 0x00, 0x00, 0x01, 11 },
+    { 0xFF, 0xFF, 0x0C, -16 },   // -0.5, truncated to -1
+    { 0xCF, 0xFF, 0x09, -397 },  // -24.8125
+    { 0x92, 0xFF, 0x0C, -880 }   // -55
+  };
+  const ChipFamily *family = findChipFamily(0x10);
+  Scratchpad scratchpad;
+
+  CHECK(!family->configurable && family->alarm);
+  for (const auto &reading : readings) {
+    uint8_t data[SCRATCHPAD_SIZE] = { reading.lsb, reading.msb, 0x4B, 0x46, 0xFF, 0xFF, reading.countRemain, 0x10 };
+
+    CHECK(decode(0x10, data, scratchpad));
+    CHECK_EQ(scratchpad.resolution, 12);
+    CHECK_EQ(scratchpad.raw, reading.raw);
+  }
+  CHECK_EQ(family->conversionTime(9), CONVERSION_TIME_12_BIT);
+
+  // COUNT_PER_C is always 16, and bytes 4 and 5 are reserved as 0xFF
+  uint8_t badCountPerC[SCRATCHPAD_SIZE] = { 0x32, 0x00, 0x4B, 0x46, 0xFF, 0xFF, 0x0C, 0x0F };
+  uint8_t badReserved[SCRATCHPAD_SIZE] = { 0x32, 0x00, 0x4B, 0x46, 0x7F, 0xFF, 0x0C, 0x10 };
+  CHECK(!decode(0x10, badCountPerC, scratchpad));
+  CHECK(!decode(0x10, badReserved, scratchpad));
+}
+
+// Page 0: status, then 1/32 C in the top 13 bits of bytes 1 and 2
+static void testDS2438() {
+  static const struct { uint8_t lsb, msb; RawTemp raw; } readings[] = {
+    { 0x00, 0x7D, 2000 },  // +125
+    { 0x10, 0x19, 401 },   // +25.0625
+    { 0x18, 0x19, 401 },   // +25.09375, the 1/32 bit is dropped
+    { 0x20, 0x0A, 162 },   // +10.125
+    { 0x80, 0x00, 8 },     // +0.5
+    { 0x00, 0x00, 0 },
+    { 0x80, 0xFF, -8 },    // -0.5
+    { 0xE0, 0xF5, -162 },  // -10.125
+    { 0xF0, 0xE6, -401 },  // -25.0625
+    { 0x00, 0xC9, -880 }   // -55
+  };
+  const ChipFamily *family = findChipFamily(0x26);
+  Scratchpad scratchpad;
+
+  CHECK(!family->configurable && !family->alarm);
+  for (const auto &reading : readings) {
+    uint8_t data[SCRATCHPAD_SIZE] = { 0x09, reading.lsb, reading.msb, 0xF4, 0x01, 0x00, 0x00, 0x40 };
+
+    CHECK(decode(0x26, data, scratchpad));
+    CHECK_EQ(scratchpad.raw, reading.raw);
+  }
+  // Read Scratchpad names the page, and so does the Recall Memory before it
+  CHECK_EQ(bus.writes, 2);
+  CHECK_EQ(bus.written[0], 0xBE);
+  CHECK_EQ(bus.written[1], 0x00);
+  byte recall[SCRATCHPAD_COMMAND_SIZE];
+  CHECK_EQ(family->recall(recall), 2);
+  CHECK_EQ(recall[0], 0xB8);
+  CHECK_EQ(recall[1], 0x00);
+  CHECK_EQ(family->conversionTime(12), CONVERSION_TIME_DS2438);
+
+  uint8_t lowBitsSet[SCRATCHPAD_SIZE] = { 0x09, 0x11, 0x19, 0xF4, 0x01, 0x00, 0x00, 0x40 };
+  CHECK(!decode(0x26, lowBitsSet, scratchpad));
+}
+
+// Conversions land in the DS2438's page 0 SRAM, not its scratchpad, so
+// every read has to recall the page first or it gets the power on page
+// back, or the reading before
+static void testDS2438Recall() {
+  static const float readings[] = { 21.5, 30.0, -10.125 };
+  static OneWireSim sim;
+  Sensor sensor(sim);
+
+  sim.addDevice(SIM_DS2438, 1, 21.5);
+  memcpy(sensor.addr, sim.device(0).rom, SENSOR_ADDR_SIZE);
+  sensor.family = findChipFamily(0x26);
+
+  for (float celsius : readings) {
+    sim.setTemperature(0, celsius);
+    sim.reset();
+    sim.skip();
+    sim.write(0x44);
+    delay(CONVERSION_TIME_DS2438);
+
+    CHECK_EQ(sensor.readScratchpad(), READ_OK);
+    CHECK_EQ(sensor.temp, static_cast<RawTemp>(celsius * 16));
+  }
+}
+
+// What every family rejects: a bad CRC, and a bus held low, which reads
+// back all zeros with a matching CRC
+static void testRejectedFrames() {
+  static const byte codes[] = { 0x10, 0x22, 0x26, 0x28, 0x42 };
+  Scratchpad scratchpad;
+
+  for (byte code : codes) {
+    uint8_t valid[SCRATCHPAD_SIZE] = { 0x32, 0x00, 0x4B, 0x46, 0xFF, 0xFF, 0x0C, 0x10 };
+    uint8_t zeros[SCRATCHPAD_SIZE] = {};
+
+    if (code == 0x26) valid[1] = 0x10;
+    if (code != 0x10 && code != 0x26) valid[4] = 0x7F;
+    CHECK(decode(code, valid, scratchpad));
+    CHECK(!decode(code, valid, scratchpad, true));
+    CHECK(!decode(code, zeros, scratchpad));
+  }
+  CHECK(findChipFamily(0x01) == NULL);
+}
+
+int main() {
+  testConfigurableResolution(0x28); // DS18B20
+  testConfigurableResolution(0x42); // DS28EA00
+  testConfigurableResolution(0x22); // DS1822
+  testDS18S20();
+  testDS2438();
+  testDS2438Recall();
+  testRejectedFrames();
+  return checkResult();
+}
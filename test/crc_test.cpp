@@ -0,0 +1,80 @@
+// The CRC variant this is built with (ONEWIRE_CRC_TABLE 0, 1 or 2) against
+// the bit at a time definitions from Maxim application note 27. Every
+// (CRC, byte) step is checked, which covers every possible input.
+#include "OneWire.h"
+#include "check.h"
+
+static uint8_t referenceCrc8(uint8_t crc, uint8_t byte) {
+  for (uint8_t i = 0; i < 8; i++) {
+    crc = ((crc ^ byte) & 1) ? (crc >> 1) ^ 0x8C : crc >> 1;
+    byte >>= 1;
+  }
+  return crc;
+}
+
+static uint16_t referenceCrc16(uint16_t crc, uint8_t byte) {
+  for (uint8_t i = 0; i < 8; i++) {
+    crc = ((crc ^ byte) & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    byte >>= 1;
+  }
+  return crc;
+}
+
+// crc8() always starts from 0, but the CRC after a first byte b takes
+// every value as b does, so all two byte inputs reach every step
+static void testCrc8Exhaustive() {
+  int mismatches = 0;
+
+  for (int first = 0; first < 256; first++) {
+    for (int second = 0; second < 256; second++) {
+      uint8_t buf[2] = { static_cast<uint8_t>(first), static_cast<uint8_t>(second) };
+      uint8_t expected = referenceCrc8(referenceCrc8(0, buf[0]), buf[1]);
+
+      if (OneWire::crc8(buf, 2) != expected) mismatches++;
+    }
+  }
+  CHECK_EQ(mismatches, 0);
+}
+
+static void testCrc16Exhaustive() {
+  int mismatches = 0;
+
+  for (uint32_t crc = 0; crc < 0x10000; crc++) {
+    for (int byte = 0; byte < 256; byte++) {
+      uint8_t buf[1] = { static_cast<uint8_t>(byte) };
+
+      if (OneWire::crc16(buf, 1, crc) != referenceCrc16(crc, buf[0])) mismatches++;
+    }
+  }
+  CHECK_EQ(mismatches, 0);
+}
+
+static void testKnownValues() {
+  uint8_t check[] = { '1', '2', '3', '4', '5', '6', '7', '8', '9' };
+  // a DS18B20 ROM, and a scratchpad reading 25.0625 C, each with its CRC
+  uint8_t rom[] = { 0x28, 0xFF, 0x4C, 0x5C, 0x41, 0x16, 0x03, 0x9A };
+  uint8_t scratchpad[9] = { 0x91, 0x01, 0x4B, 0x46, 0x7F, 0xFF, 0x0F, 0x10, 0x00 };
+  uint8_t inverted[2];
+
+  CHECK_EQ(OneWire::crc8(check, 9), 0xA1);
+  CHECK_EQ(OneWire::crc16(check, 9), 0xBB3D);
+
+  rom[7] = OneWire::crc8(rom, 7);
+  CHECK_EQ(OneWire::crc8(rom, 8), 0);
+  scratchpad[8] = OneWire::crc8(scratchpad, 8);
+  CHECK_EQ(OneWire::crc8(scratchpad, 9), 0);
+
+  // devices send the CRC16 inverted, low byte first
+  inverted[0] = ~0xBB3D & 0xFF;
+  inverted[1] = ~0xBB3D >> 8 & 0xFF;
+  CHECK(OneWire::check_crc16(check, 9, inverted));
+  inverted[0] ^= 1;
+  CHECK(!OneWire::check_crc16(check, 9, inverted));
+}
+
+int main() {
+  testCrc8Exhaustive();
+  testCrc16Exhaustive();
+  testKnownValues();
+  return checkResult();
+}
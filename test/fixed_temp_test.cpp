@@ -0,0 +1,76 @@
+// The fixed point helpers against the floating point they replaced:
+// formatFixed() against "%.4f", rawToFahrenheit() against C * 1.8 + 32
+// and divRound() against lround().
+#include "FixedTemp.h"
+#include "check.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static void testFahrenheitIsExact() {
+  int mismatches = 0;
+
+  for (int32_t raw = INT16_MIN + 1; raw <= INT16_MAX; raw++) {
+    // raw / 16 * 1.8 + 32, times FAHRENHEIT_SCALE, in exact integers
+    if (rawToFahrenheit(raw) * 16 != raw * 18 * 1000 + 32 * FAHRENHEIT_SCALE * 16) mismatches++;
+  }
+  CHECK_EQ(mismatches, 0);
+  CHECK_EQ(rawToFahrenheit(0), 320000);
+  CHECK_EQ(rawToFahrenheit(RAW_TEMP_MIN), -299875);
+  CHECK_EQ(rawToFahrenheit(RAW_TEMP_MAX), 1199750);
+  CHECK_EQ(rawDeltaToFahrenheit(16), 18000);
+}
+
+static void testFormatMatchesPrintf() {
+  char fixed[20];
+  char printed[20];
+  int mismatches = 0;
+
+  for (int32_t raw = -2000; raw <= 2000; raw++) {
+    int32_t fahrenheit = rawToFahrenheit(raw);
+    size_t length = formatFixed(fixed, sizeof(fixed), fahrenheit, 4);
+
+    snprintf(printed, sizeof(printed), "%.4f", fahrenheit / static_cast<double>(FAHRENHEIT_SCALE));
+    if (strcmp(fixed, printed) != 0 || length != strlen(printed)) mismatches++;
+  }
+  CHECK_EQ(mismatches, 0);
+}
+
+static void testFormatEdges() {
+  char buf[20];
+
+  formatFixed(buf, sizeof(buf), -123456, 4);
+  CHECK(strcmp(buf, "-12.3456") == 0);
+  formatFixed(buf, sizeof(buf), -5, 4);
+  CHECK(strcmp(buf, "-0.0005") == 0);
+  formatFixed(buf, sizeof(buf), 42, 0);
+  CHECK(strcmp(buf, "42") == 0);
+  formatFixed(buf, sizeof(buf), INT32_MIN, 4);
+  CHECK(strcmp(buf, "-214748.3648") == 0);
+
+  // truncates like snprintf, and says how much it wrote
+  CHECK_EQ(formatFixed(buf, 5, 1234567, 4), 4);
+  CHECK(strcmp(buf, "123.") == 0);
+  CHECK_EQ(formatFixed(buf, 1, 1, 0), 0);
+  CHECK_EQ(buf[0], '\0');
+}
+
+static void testDivRound() {
+  int mismatches = 0;
+
+  for (int32_t n = -5000; n <= 5000; n++) {
+    for (int32_t d = 1; d <= 12; d++) {
+      if (divRound(n, d) != lround(static_cast<double>(n) / d)) mismatches++;
+      if (divRound(n, -d) != lround(static_cast<double>(n) / -d)) mismatches++;
+    }
+  }
+  CHECK_EQ(mismatches, 0);
+}
+
+int main() {
+  testFahrenheitIsExact();
+  testFormatMatchesPrintf();
+  testFormatEdges();
+  testDivRound();
+  return checkResult();
+}
@@ -0,0 +1,88 @@
+// Histogram bucketing and its Prometheus text, line for line, with counts
+// and a sum too big for 32 bits.
+#include "Histogram.h"
+#include "check.h"
+#include <string>
+
+class Capture : public Print {
+  public:
+    std::string text;
+
+    using Print::write;
+    size_t write(uint8_t c) {
+      text += static_cast<char>(c);
+      return 1;
+    }
+};
+
+// A bound belongs to its own bucket, one past it to the next, and anything
+// past the last bound to +Inf
+static void testBuckets() {
+  Histogram histogram;
+
+  histogram.observe(0);
+  histogram.observe(100);
+  histogram.observe(101);
+  histogram.observe(1000000);
+  histogram.observe(1000001);
+
+  CHECK_EQ(histogram.buckets[0], 2);
+  CHECK_EQ(histogram.buckets[1], 1);
+  CHECK_EQ(histogram.buckets[HISTOGRAM_BUCKETS - 1], 1);
+  CHECK_EQ(histogram.buckets[HISTOGRAM_BUCKETS], 1);
+  CHECK_EQ(histogram.count, 5);
+  CHECK_EQ(histogram.sum, 2000202);
+}
+
+// Cumulative buckets with the bounds in seconds, then the sum and count.
+// The sum is over 2^32us and the count over 2^31, where a mismatched
+// format would show.
+static void testText() {
+  Histogram histogram;
+  Capture out;
+
+  histogram.observe(300);
+  histogram.observe(4000000000UL);
+  histogram.observe(4000000000UL);
+  histogram.buckets[0] = 3000000000UL;
+  histogram.count += 3000000000UL;
+
+  histogram.write(out, "onewire_reset_seconds", "bus=\"1\"");
+  CHECK(out.text ==
+    "onewire_reset_seconds_bucket{bus=\"1\",le=\"0.000100\"} 3000000000\n"
+    "onewire_reset_seconds_bucket{bus=\"1\",le=\"0.000250\"} 3000000000\n"
+    "onewire_reset_seconds_bucket{bus=\"1\",le=\"0.000500\"} 3000000001\n"
+    "onewire_reset_seconds_bucket{bus=\"1\",le=\"0.001000\"} 3000000001\n"
+    "onewire_reset_seconds_bucket{bus=\"1\",le=\"0.002500\"} 3000000001\n"
+    "onewire_reset_seconds_bucket{bus=\"1\",le=\"0.005000\"} 3000000001\n"
+    "onewire_reset_seconds_bucket{bus=\"1\",le=\"0.010000\"} 3000000001\n"
+    "onewire_reset_seconds_bucket{bus=\"1\",le=\"0.025000\"} 3000000001\n"
+    "onewire_reset_seconds_bucket{bus=\"1\",le=\"0.050000\"} 3000000001\n"
+    "onewire_reset_seconds_bucket{bus=\"1\",le=\"0.100000\"} 3000000001\n"
+    "onewire_reset_seconds_bucket{bus=\"1\",le=\"0.250000\"} 3000000001\n"
+    "onewire_reset_seconds_bucket{bus=\"1\",le=\"0.500000\"} 3000000001\n"
+    "onewire_reset_seconds_bucket{bus=\"1\",le=\"1.000000\"} 3000000001\n"
+    "onewire_reset_seconds_bucket{bus=\"1\",le=\"+Inf\"} 3000000003\n"
+    "onewire_reset_seconds_sum{bus=\"1\"} 8000.000300\n"
+    "onewire_reset_seconds_count{bus=\"1\"} 3000000003\n");
+}
+
+// Without labels the le label stands alone and the braces stay empty
+static void testNoLabels() {
+  Histogram histogram;
+  Capture out;
+
+  histogram.observe(750000);
+  histogram.write(out, "onewire_conversion_wait_seconds", "");
+  CHECK(out.text.find("onewire_conversion_wait_seconds_bucket{le=\"0.500000\"} 0\n") != std::string::npos);
+  CHECK(out.text.find("onewire_conversion_wait_seconds_bucket{le=\"1.000000\"} 1\n") != std::string::npos);
+  CHECK(out.text.find("onewire_conversion_wait_seconds_sum{} 0.750000\n") != std::string::npos);
+  CHECK(out.text.find("onewire_conversion_wait_seconds_count{} 1\n") != std::string::npos);
+}
+
+int main() {
+  testBuckets();
+  testText();
+  testNoLabels();
+  return checkResult();
+}
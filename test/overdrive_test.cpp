@@ -0,0 +1,71 @@
+// Sensor::probeOverdrive() only turns overdrive on for a sensor that
+// returns a valid scratchpad at overdrive speed, and scratchpad reads
+// then go at that speed.
+#include "OneWireSim.h"
+#include "Sensor.h"
+#include "check.h"
+
+static bool probe(OneWireSim &bus, uint16_t index, Sensor &sensor) {
+  sensor = Sensor(bus);
+  memcpy(sensor.addr, bus.device(index).rom, SENSOR_ADDR_SIZE);
+  sensor.family = findChipFamily(sensor.addr[0]);
+  return sensor.probeOverdrive();
+}
+
+static void testProbe() {
+  static OneWireSim bus;
+  Sensor sensor;
+
+  bus.addDevice(SIM_DS28EA00, 1, 21.0);
+  bus.addDevice(SIM_DS18B20, 2, 22.0);
+
+  CHECK(probe(bus, 0, sensor));
+  CHECK(sensor.overdrive);
+  CHECK(!bus.overdrive());
+
+  // answers the overdrive reset but not at overdrive speed
+  CHECK(!probe(bus, 1, sensor));
+  CHECK(!sensor.overdrive);
+
+  // present at overdrive, but the data doesn't come through: a presence
+  // pulse alone would have turned overdrive on
+  bus.corruptNextReads(0, 1);
+  CHECK(!probe(bus, 0, sensor));
+  CHECK(!sensor.overdrive);
+  CHECK(!bus.overdrive());
+
+  // both still read at standard speed afterwards
+  CHECK(probe(bus, 0, sensor));
+  sensor.read();
+  CHECK_EQ(sensor.temp, 21 * 16);
+  CHECK(!bus.overdrive());
+}
+
+// An overdrive read takes about a tenth of the bus time
+static void testOverdriveReadIsFaster() {
+  static OneWireSim bus;
+  Sensor sensor;
+  unsigned long long standard, fast;
+
+  bus.addDevice(SIM_DS28EA00, 1, 21.0);
+  probe(bus, 0, sensor);
+  sensor.read();
+
+  sensor.overdrive = false;
+  bus.resetBusMicros();
+  CHECK_EQ(sensor.readScratchpad(), READ_OK);
+  standard = bus.busMicros();
+
+  sensor.overdrive = true;
+  bus.resetBusMicros();
+  CHECK_EQ(sensor.readScratchpad(), READ_OK);
+  fast = bus.busMicros();
+
+  CHECK(fast * 3 < standard);
+}
+
+int main() {
+  testProbe();
+  testOverdriveReadIsFaster();
+  return checkResult();
+}
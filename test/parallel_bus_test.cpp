@@ -0,0 +1,136 @@
+// OneWireParallel on four lanes of a simulated GPIO port, each wired to
+// its own simulated bus: per lane searches, slots that stay in spec with
+// interrupt handlers eating into them, and Sensors reading a sensor from
+// every lane in the time of one read.
+#include "OneWireParallel.h"
+#include "OneWireSimPin.h"
+#include "Sensors.h"
+#include "check.h"
+
+#define LANES 4
+#define FIRST_PIN 16 // the second port of the host's pin map
+#define OTHER_PORT_PIN 40
+// What WiFi handlers can take out of a slot on a Photon, enough to push
+// a 0 held over a re-enable past 120us
+#define LATENCY_US 60
+
+static const int deviceCounts[LANES] = { 1, 2, 3, 1 };
+static const uint16_t pins[] = { FIRST_PIN, FIRST_PIN + 1, FIRST_PIN + 2, FIRST_PIN + 3, OTHER_PORT_PIN };
+
+static OneWireSim sims[LANES];
+static OneWireSimPin wires[LANES] = { sims[0], sims[1], sims[2], sims[3] };
+static OneWireParallel parallel(pins, sizeof(pins) / sizeof(pins[0]));
+
+static uint32_t badSlots() {
+  uint32_t bad = 0;
+
+  for (int lane = 0; lane < LANES; lane++) bad += wires[lane].badSlots;
+  return bad;
+}
+
+static bool onLane(int lane, const uint8_t rom[8]) {
+  for (int i = 0; i < deviceCounts[lane]; i++) {
+    if (memcmp(rom, sims[lane].device(i).rom, 8) == 0) return true;
+  }
+  return false;
+}
+
+// Runs one acquisition cycle the way loop() does, one poll() a
+// millisecond. Returns how many polls read scratchpads, the only ones
+// that take more than a few ms.
+static int acquire(Sensors &sensors) {
+  int reads = 0;
+  unsigned long started = millis();
+
+  sensors.start();
+  while (sensors.busy() && millis() - started < 2000) {
+    unsigned long polled = micros();
+
+    sensors.poll();
+    if (micros() - polled > 5000) reads++;
+    delay(1);
+  }
+  CHECK(!sensors.busy());
+  return reads;
+}
+
+static void testLanes() {
+  CHECK_EQ(parallel.lanes(), 0x0F); // the pin on another port is dropped
+  CHECK_EQ(parallel.reset(), 0x0F);
+}
+
+static void testSearch() {
+  uint8_t roms[ONEWIRE_PARALLEL_LANES][8];
+  int found[LANES] = {};
+  uint8_t lanes;
+
+  parallel.reset_search();
+  while ((lanes = parallel.search(roms)) != 0) {
+    for (int lane = 0; lane < LANES; lane++) {
+      if (!(lanes & (1 << lane))) continue;
+
+      CHECK(onLane(lane, roms[lane]));
+      found[lane]++;
+    }
+  }
+  for (int lane = 0; lane < LANES; lane++) CHECK_EQ(found[lane], deviceCounts[lane]);
+  CHECK_EQ(badSlots(), 0);
+}
+
+// Zeros are held low through the whole slot with interrupts off, so time
+// lost to other handlers lands in the recovery time instead
+static void testSlotsWithInterruptLatency() {
+  static const uint8_t perLane[ONEWIRE_PARALLEL_LANES] = { 0x00, 0xFF, 0x55, 0xAA };
+  unsigned long started = micros();
+
+  parallel.write(0x80);
+  parallel.write(perLane);
+  CHECK_EQ(micros() - started, 16 * (70 + LATENCY_US));
+  CHECK_EQ(badSlots(), 0);
+}
+
+// Every lane's next sensor is read in the same slots: seven sensors on
+// lanes of 1, 2, 3 and 1 take three reads. The last lane's is a DS2438,
+// which has the others sit out its Recall Memory.
+static void testSensorsReadLanes() {
+  static Sensors sensors(parallel);
+  int32_t sum = 0;
+
+  sensors.scan();
+  CHECK_EQ(sensors.count(), 7);
+
+  CHECK_EQ(acquire(sensors), 3);
+  for (int lane = 0; lane < LANES; lane++) {
+    for (int i = 0; i < deviceCounts[lane]; i++) sum += (20 + lane + i) * 16;
+  }
+  CHECK_EQ(sensors.temp, divRound(sum, 7));
+  CHECK_EQ(badSlots(), 0);
+
+  // a garbled read is retried with the lanes that still have sensors to
+  // read, and a lane whose sensor is gone doesn't hold the others up
+  sims[2].setTemperature(0, 30.0);
+  sims[2].corruptNextReads(0, 1);
+  sims[3].setPresent(0, false);
+  acquire(sensors);
+  CHECK_EQ(sims[2].device(0).corruptReads, 0);
+  CHECK_EQ(sensors.temp, divRound(sum + (30 - 22) * 16, 7));
+  CHECK_EQ(badSlots(), 0);
+}
+
+int main() {
+  for (int lane = 0; lane < LANES; lane++) {
+    hostAttachPin(FIRST_PIN + lane, &wires[lane]);
+    for (int i = 0; i < deviceCounts[lane]; i++) {
+      SimDeviceModel model = lane == LANES - 1 ? SIM_DS2438 : SIM_DS18B20;
+
+      sims[lane].addDevice(model, 16 * lane + i + 1, 20.0 + lane + i);
+    }
+  }
+  hostInterruptLatency(LATENCY_US);
+
+  testLanes();
+  testSearch();
+  testSlotsWithInterruptLatency();
+  testSensorsReadLanes();
+  return checkResult();
+}
@@ -0,0 +1,70 @@
+// RingWindow against a brute force recount of the last N samples, with
+// empty slots mixed in, and with a float sum to check the rounding doesn't
+// build up.
+#include "RingWindow.h"
+#include "FixedTemp.h"
+#include "check.h"
+#include <math.h>
+
+static uint32_t seed = 1;
+
+static uint32_t nextRandom() {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+template<uint8_t N>
+static void testMatchesRecount() {
+  typedef RingWindow<RawTemp, N, int32_t> Window;
+  Window window;
+  RawTemp history[2000];
+  int mismatches = 0;
+
+  CHECK_EQ(window.count(), 0);
+  CHECK_EQ(window.total(), 0);
+  CHECK_EQ(Window::EMPTY, RAW_TEMP_INVALID);
+
+  for (int i = 0; i < 2000; i++) {
+    RawTemp sample = nextRandom() % 8 == 0 ? RAW_TEMP_INVALID : static_cast<RawTemp>(nextRandom() % 1334) + RAW_TEMP_MIN;
+    int32_t total = 0;
+    uint8_t count = 0;
+
+    history[i] = sample;
+    window.push(sample);
+
+    for (int j = i - N + 1; j <= i; j++) {
+      RawTemp expected = j < 0 ? RAW_TEMP_INVALID : history[j];
+
+      if (window[j - (i - N + 1)] != expected) mismatches++;
+      if (expected == RAW_TEMP_INVALID) continue;
+      total += expected;
+      count++;
+    }
+    if (window.total() != total || window.count() != count) mismatches++;
+  }
+  CHECK_EQ(mismatches, 0);
+}
+
+// Float sums are recomputed on every wrap, so after millions of samples
+// the total is still the sum of what's in the window
+static void testFloatSumDoesNotDrift() {
+  RingWindow<float, 6> window;
+  float expected = 0;
+
+  for (long i = 0; i < 2000000; i++) {
+    window.push(static_cast<float>(nextRandom() % 100000) / 1000.0f + 0.001f);
+  }
+  for (uint8_t i = 0; i < 6; i++) expected += window[i];
+  CHECK(fabsf(window.total() - expected) < 1e-3f);
+  CHECK_EQ(window.count(), 6);
+}
+
+int main() {
+  testMatchesRecount<1>();
+  testMatchesRecount<6>();
+  testMatchesRecount<7>();
+  testFloatSumDoesNotDrift();
+  return checkResult();
+}
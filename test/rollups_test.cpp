@@ -0,0 +1,102 @@
+// The Rollups cascade against bucketing every sample directly into each
+// level, over samples at random spacing with the odd long gap.
+#include "Rollups.h"
+#include "check.h"
+#include <map>
+
+static uint32_t seed = 1;
+
+static uint32_t nextRandom() {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+typedef std::map<uint32_t, RollupBucket> Buckets;
+
+static bool sameBucket(const RollupBucket &a, const RollupBucket &b) {
+  return a.start == b.start && a.sum == b.sum && a.count == b.count && a.min == b.min && a.max == b.max;
+}
+
+// The ring holds the last buckets the brute force found for the level
+template<uint8_t N>
+static int compare(const RollupRing<N> &ring, const Buckets &expected) {
+  int mismatches = 0;
+  uint8_t count = expected.size() < N ? expected.size() : N;
+  Buckets::const_iterator it = expected.end();
+
+  if (ring.count() != count) return 1;
+  for (uint8_t i = count; i > 0; i--) {
+    --it;
+    if (!sameBucket(ring[i - 1], it->second)) mismatches++;
+  }
+  return mismatches;
+}
+
+static void testMatchesBruteForce() {
+  static const uint32_t periods[ROLLUP_LEVELS] = { 60, 300, 3600 };
+  Rollups<ROLLUP_MINUTES, ROLLUP_FIVE_MINUTES, ROLLUP_HOURS> rollups;
+  Buckets expected[ROLLUP_LEVELS];
+  uint32_t now = 1000;
+
+  for (long i = 0; i < 200000; i++) {
+    RawTemp sample = static_cast<RawTemp>(nextRandom() % 1334) + RAW_TEMP_MIN;
+
+    // mostly a few seconds apart, sometimes minutes, now and then hours
+    switch (nextRandom() % 1000) {
+    case 0: now += nextRandom() % 20000; break;
+    case 1: case 2: case 3: now += nextRandom() % 900; break;
+    default: now += nextRandom() % 20; break;
+    }
+
+    rollups.add(sample, now);
+    for (uint8_t level = 0; level < ROLLUP_LEVELS; level++) {
+      RollupBucket &bucket = expected[level][now - now % periods[level]];
+
+      bucket.start = now - now % periods[level];
+      bucket.add(sample);
+    }
+
+    // while it runs, every minute before the current one has closed
+    if (i % 9973 == 0) {
+      Buckets closed(expected[ROLLUP_1M].begin(), expected[ROLLUP_1M].lower_bound(now - now % 60));
+
+      CHECK_EQ(compare(rollups.minuteBuckets(), closed), 0);
+    }
+  }
+
+  // everything closes once every period has run out
+  rollups.settle(now + 2 * 3600);
+  CHECK_EQ(compare(rollups.minuteBuckets(), expected[ROLLUP_1M]), 0);
+  CHECK_EQ(compare(rollups.fiveMinuteBuckets(), expected[ROLLUP_5M]), 0);
+  CHECK_EQ(compare(rollups.hourBuckets(), expected[ROLLUP_1H]), 0);
+  CHECK(sameBucket(*rollups.latest(ROLLUP_1H), expected[ROLLUP_1H].rbegin()->second));
+}
+
+static void testLatest() {
+  Rollups<2, 2, 2> rollups;
+
+  CHECK(rollups.latest(ROLLUP_1M) == NULL);
+  rollups.add(320, 0);
+  rollups.add(336, 59);
+  CHECK(rollups.latest(ROLLUP_1M) == NULL);
+
+  // a quiet sensor's minute still closes when it's settled
+  rollups.settle(60);
+  CHECK(rollups.latest(ROLLUP_1M) != NULL);
+  CHECK_EQ(rollups.latest(ROLLUP_1M)->mean(), 328);
+  CHECK_EQ(rollups.latest(ROLLUP_1M)->min, 320);
+  CHECK_EQ(rollups.latest(ROLLUP_1M)->max, 336);
+  CHECK(rollups.latest(ROLLUP_5M) == NULL);
+
+  rollups.settle(300);
+  CHECK_EQ(rollups.latest(ROLLUP_5M)->count, 2);
+  CHECK(rollups.latest(ROLLUP_1H) == NULL);
+}
+
+int main() {
+  testMatchesBruteForce();
+  testLatest();
+  return checkResult();
+}
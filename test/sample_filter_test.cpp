@@ -0,0 +1,138 @@
+// The median networks against a sort, and each filter mode on the signals
+// it's there for: steady readings with 1/16 C noise, one bad conversion,
+// and a real step change.
+#include "SampleFilter.h"
+#include "check.h"
+#include <algorithm>
+
+static uint32_t seed = 1;
+
+static uint32_t nextRandom() {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+// By the 0-1 principle a network that sorts every input of 0s and 1s
+// sorts everything
+template<uint8_t N>
+static void testNetworkSorts() {
+  int unsorted = 0;
+
+  for (uint32_t bits = 0; bits < (1U << N); bits++) {
+    RawTemp values[N];
+
+    for (uint8_t i = 0; i < N; i++) values[i] = (bits >> i) & 1;
+    medianOf<N>(values);
+    if (!std::is_sorted(values, values + N)) unsorted++;
+  }
+  CHECK_EQ(unsorted, 0);
+}
+
+template<uint8_t N>
+static void testMedianMatchesSort() {
+  int mismatches = 0;
+
+  for (long round = 0; round < 100000; round++) {
+    RawTemp values[N];
+    RawTemp sorted[N];
+    RawTemp partial[N];
+    uint8_t count = 1 + nextRandom() % N;
+
+    for (uint8_t i = 0; i < N; i++) {
+      values[i] = static_cast<RawTemp>(nextRandom() % 2001) - 1000;
+      sorted[i] = values[i];
+      partial[i] = values[i];
+    }
+    std::sort(sorted, sorted + N);
+    if (medianOf<N>(values) != sorted[N / 2]) mismatches++;
+
+    std::copy(partial, partial + count, sorted);
+    std::sort(sorted, sorted + count);
+    if (partialMedian(partial, count) != sorted[count / 2]) mismatches++;
+  }
+  CHECK_EQ(mismatches, 0);
+}
+
+// The median mode gives the median of the last FILTER_SIZE samples, of
+// fewer while it fills up
+static void testMedianMode() {
+  SampleFilter filter;
+  RawTemp samples[1000];
+  int mismatches = 0;
+
+  filter.setMode(FILTER_MEDIAN);
+  CHECK_EQ(filter.mode(), FILTER_MEDIAN);
+  for (int i = 0; i < 1000; i++) {
+    RawTemp last[FILTER_SIZE];
+    int count = i + 1 < FILTER_SIZE ? i + 1 : FILTER_SIZE;
+
+    samples[i] = static_cast<RawTemp>(nextRandom() % 801);
+    std::copy(samples + i + 1 - count, samples + i + 1, last);
+    std::sort(last, last + count);
+    if (filter.update(samples[i]) != last[count / 2]) mismatches++;
+  }
+  CHECK_EQ(mismatches, 0);
+}
+
+// Hampel leaves good readings alone, swaps a lone spike for the median and
+// follows a step once most of the history is on the new level
+static void testHampel() {
+  SampleFilter filter;
+  int changed = 0;
+
+  CHECK_EQ(filter.mode(), FILTER_HAMPEL);
+  for (int i = 0; i < 100; i++) {
+    RawTemp sample = 18 * 16 + static_cast<RawTemp>(nextRandom() % 3) - 1;
+
+    if (filter.update(sample) != sample) changed++;
+  }
+  CHECK_EQ(changed, 0);
+
+  for (int i = 0; i < FILTER_SIZE; i++) filter.update(18 * 16);
+  CHECK_EQ(filter.update(45 * 16), 18 * 16);
+  CHECK_EQ(filter.update(18 * 16), 18 * 16);
+
+  for (int i = 0; i < FILTER_SIZE; i++) filter.update(18 * 16);
+  for (int i = 0; i < FILTER_SIZE / 2; i++) CHECK_EQ(filter.update(25 * 16), 18 * 16);
+  CHECK_EQ(filter.update(25 * 16), 25 * 16);
+  CHECK_EQ(filter.update(25 * 16), 25 * 16);
+}
+
+// The EWMA settles exactly on a steady reading, a quarter of the way per
+// sample
+static void testEwma() {
+  SampleFilter filter;
+  RawTemp filtered = 0;
+
+  filter.setMode(FILTER_EWMA);
+  CHECK_EQ(filter.update(320), 320);
+  CHECK_EQ(filter.update(384), 336);
+  CHECK_EQ(filter.update(384), 348);
+  for (int i = 0; i < 100; i++) filtered = filter.update(384);
+  CHECK_EQ(filtered, 384);
+
+  for (int i = 0; i < 100; i++) filtered = filter.update(-100);
+  CHECK_EQ(filtered, -100);
+}
+
+static void testNone() {
+  SampleFilter filter;
+
+  filter.setMode(FILTER_NONE);
+  CHECK_EQ(filter.update(45 * 16), 45 * 16);
+  CHECK_EQ(filter.update(RAW_TEMP_MIN), RAW_TEMP_MIN);
+}
+
+int main() {
+  testNetworkSorts<5>();
+  testNetworkSorts<7>();
+  testMedianMatchesSort<5>();
+  testMedianMatchesSort<7>();
+  testMedianMode();
+  testHampel();
+  testEwma();
+  testNone();
+  return checkResult();
+}
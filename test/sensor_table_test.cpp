@@ -0,0 +1,110 @@
+// SensorTable against std::map under random inserts, replacements, finds
+// and removals, filling it up and emptying it again, with every lookup
+// and the packed array checked against the map as it goes.
+#include "SensorTable.h"
+#include "check.h"
+#include <map>
+
+#define CAPACITY 24
+#define KEYS 96
+#define OPERATIONS 200000
+
+static uint32_t seed = 1;
+
+static uint32_t nextRandom() {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static uint64_t keys[KEYS];
+static SensorTable<CAPACITY> table;
+static std::map<uint64_t, int> reference;
+
+// Half the keys look like a run of DS18B20s with sequential serials, the
+// rest are random
+static void makeKeys() {
+  for (int i = 0; i < KEYS; i++) {
+    if (i % 2 == 0) {
+      keys[i] = 0x28 | (static_cast<uint64_t>(i + 1) << 8);
+    } else {
+      keys[i] = (static_cast<uint64_t>(nextRandom()) << 32) | nextRandom();
+    }
+  }
+}
+
+// Every key is found, or not, as the map has it, and the packed array
+// holds exactly the map's sensors
+static bool matchesReference() {
+  std::map<uint64_t, int> packed;
+
+  if (table.size() != reference.size()) return false;
+  for (int i = 0; i < KEYS; i++) {
+    std::map<uint64_t, int>::const_iterator it = reference.find(keys[i]);
+    Sensor *sensor = table.find(keys[i]);
+
+    if (table.contains(keys[i]) != (it != reference.end())) return false;
+    if (it == reference.end() ? sensor != NULL : sensor == NULL || sensor->id != it->second) return false;
+  }
+  for (Sensor *it = table.begin(); it != table.end(); ++it) {
+    packed[it->id / KEYS] = it->id;
+  }
+  for (std::map<uint64_t, int>::const_iterator it = reference.begin(); it != reference.end(); ++it) {
+    if (packed[it->second / KEYS] != it->second) return false;
+  }
+  return packed.size() == reference.size();
+}
+
+// Inserts win about as often as removals, so the table spends a while
+// full and a while near empty. The id encodes a serial number and the
+// key's index, so each insert's sensor is distinct.
+static void testAgainstMap() {
+  int mismatches = 0;
+  int full = 0;
+
+  for (int serial = 0; serial < OPERATIONS; serial++) {
+    int k = nextRandom() % KEYS;
+    uint32_t op = nextRandom() % 100;
+
+    if (op < 50) {
+      Sensor sensor;
+      bool present = reference.count(keys[k]) != 0;
+
+      sensor.id = serial * KEYS + k;
+      Sensor *stored = table.insert(keys[k], sensor);
+      if (!present && reference.size() == CAPACITY) {
+        if (stored != NULL) mismatches++;
+        full++;
+      } else {
+        if (stored == NULL || stored->id != sensor.id) mismatches++;
+        reference[keys[k]] = sensor.id;
+      }
+    } else if (op < 98) {
+      if (table.remove(keys[k]) != (reference.erase(keys[k]) != 0)) mismatches++;
+    } else {
+      // drop every sensor whose key index is odd
+      uint16_t expected = 0;
+
+      for (std::map<uint64_t, int>::iterator it = reference.begin(); it != reference.end();) {
+        if (it->second % KEYS % 2) {
+          reference.erase(it++);
+          expected++;
+        } else {
+          ++it;
+        }
+      }
+      if (table.remove_if([](const Sensor &sensor) { return sensor.id % KEYS % 2 != 0; }) != expected) mismatches++;
+    }
+    if (!matchesReference()) mismatches++;
+  }
+  CHECK_EQ(mismatches, 0);
+  // the walk actually reached a full table
+  CHECK(full > 0);
+}
+
+int main() {
+  makeKeys();
+  testAgainstMap();
+  return checkResult();
+}
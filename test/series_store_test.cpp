@@ -0,0 +1,200 @@
+// SeriesStore round trips: whatever goes in comes back out, oldest first,
+// for every kind of step the encoding has a code for, with several sensors
+// sharing the pool and the oldest chunks being recycled. Then the history
+// endpoint's paging on top of it.
+#include "SeriesStore.h"
+#include "OneWireSim.h"
+#include "Sensors.h"
+#include "check.h"
+#include <string>
+#include <vector>
+
+static uint32_t seed = 1;
+
+static uint32_t nextRandom() {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+struct Sample {
+  uint32_t time;
+  RawTemp value;
+};
+
+// Steady runs, 1/16 C flicker, mid sized steps, jumps that need the
+// 16 bit literal, and gaps from a second to days
+static Sample nextSample(const Sample &last) {
+  Sample next = last;
+  uint32_t kind = nextRandom() % 100;
+
+  next.time += kind < 90 ? 10 : kind < 97 ? 1 + nextRandom() % 120 : nextRandom() % 500000;
+  if (kind % 3 == 0) {
+    next.value = last.value;
+  } else if (kind % 3 == 1) {
+    next.value = last.value + static_cast<RawTemp>(nextRandom() % 5) - 2;
+  } else if (kind < 50) {
+    next.value = last.value + static_cast<RawTemp>(nextRandom() % 101) - 50;
+  } else {
+    next.value = static_cast<RawTemp>(nextRandom() % 4000) - 2000;
+  }
+  if (next.value == RAW_TEMP_INVALID) next.value++;
+  return next;
+}
+
+// What the store hands back for a sensor is the tail of what went in,
+// reaching all the way to the latest sample
+static int checkTail(const SeriesStore &store, uint64_t key, const std::vector<Sample> &appended, uint32_t since = 0) {
+  SeriesIterator series(store, key);
+  std::vector<Sample> decoded;
+  Sample sample;
+  size_t offset;
+  int mismatches = 0;
+
+  if (since != 0) series.skipTo(since);
+  while (series.next(sample.time, sample.value)) decoded.push_back(sample);
+  if (decoded.size() > appended.size() || decoded.empty()) return 1;
+
+  offset = appended.size() - decoded.size();
+  for (size_t i = 0; i < decoded.size(); i++) {
+    if (decoded[i].time != appended[offset + i].time || decoded[i].value != appended[offset + i].value) mismatches++;
+  }
+  // skipTo() only passes over chunks that are entirely at or before since
+  if (since != 0 && offset > 0 && appended[offset].time > since) mismatches++;
+  return mismatches;
+}
+
+static void testRoundTrip() {
+  static const int SENSORS = 5;
+  static SeriesStore store;
+  std::vector<Sample> appended[SENSORS];
+  uint16_t hints[SENSORS];
+  Sample last[SENSORS];
+  int mismatches = 0;
+
+  for (int s = 0; s < SENSORS; s++) {
+    hints[s] = SERIES_NO_CHUNK;
+    last[s].time = 1000 + s;
+    last[s].value = 300;
+  }
+
+  for (long i = 0; i < 200000; i++) {
+    // the sensors take turns unevenly, so their chunks interleave
+    int s = nextRandom() % 7 % SENSORS;
+
+    last[s] = nextSample(last[s]);
+    store.append(0x2800000000000000ULL + s, hints[s], last[s].time, last[s].value);
+    appended[s].push_back(last[s]);
+
+    if (i % 20011 == 0) mismatches += checkTail(store, 0x2800000000000000ULL + s, appended[s]);
+  }
+  CHECK_EQ(mismatches, 0);
+  CHECK_EQ(store.chunksUsed(), SERIES_CHUNKS);
+
+  for (int s = 0; s < SENSORS; s++) {
+    const std::vector<Sample> &samples = appended[s];
+
+    CHECK_EQ(checkTail(store, 0x2800000000000000ULL + s, samples), 0);
+    CHECK_EQ(checkTail(store, 0x2800000000000000ULL + s, samples, samples[samples.size() - 50].time), 0);
+  }
+}
+
+// A long steady run stays one code until something changes, and the
+// run still being counted reads back too
+static void testRuns() {
+  static SeriesStore store;
+  std::vector<Sample> appended;
+  uint16_t hint = SERIES_NO_CHUNK;
+
+  for (uint32_t i = 0; i < 70000; i++) {
+    Sample sample = { 10 * i, static_cast<RawTemp>(i < 40000 ? 288 : 289) };
+
+    store.append(1, hint, sample.time, sample.value);
+    appended.push_back(sample);
+  }
+  CHECK_EQ(checkTail(store, 1, appended), 0);
+  // 0xFFFF samples to a chunk, the rest in a second one
+  CHECK_EQ(store.chunksUsed(), 2);
+}
+
+class Capture : public Print {
+  public:
+    std::string text;
+
+    using Print::write;
+    size_t write(uint8_t c) {
+      text += static_cast<char>(c);
+      return 1;
+    }
+
+    int lines() const {
+      int n = 0;
+
+      for (char c : text) n += c == '\n';
+      return n;
+    }
+};
+
+// Paging through a sensor's history a page at a time gives every sample
+// once, in order, the same as asking for all of it
+static void testHistoryPages() {
+  static OneWireSim bus;
+  Sensors sensors(bus);
+  const int32_t clockOffset = 1700000000;
+  byte addr[SENSOR_ADDR_SIZE];
+  Capture index, all, pages;
+  uint32_t since = 0;
+  uint16_t written;
+  int count = 0;
+
+  bus.addDevice(SIM_DS18B20, 1, 18.0);
+  bus.addDevice(SIM_DS18B20, 2, 19.0);
+  memcpy(addr, bus.device(0).rom, SENSOR_ADDR_SIZE);
+  sensors.scan();
+
+  for (int cycle = 0; cycle < 240; cycle++) {
+    bus.setTemperature(0, 18.0 + (cycle % 7) / 16.0);
+    bus.setTemperature(1, 19.0 + (cycle % 5) / 16.0);
+    // sensors that have backed off skip cycles, those don't start at all
+    sensors.start();
+    while (sensors.busy()) {
+      sensors.poll();
+      delay(1);
+    }
+    delay(2000);
+  }
+
+  sensors.writeHistoryIndex(index, clockOffset);
+  CHECK_EQ(index.lines(), 3);
+  CHECK(index.text.find("28010000000000") != std::string::npos);
+  CHECK(index.text.find("28020000000000") != std::string::npos);
+
+  // the sensors back off while they're steady, so not one a cycle
+  CHECK(sensors.writeHistory(all, clockOffset, addr, 0, 0xFFFF) > 60);
+
+  do {
+    Capture page;
+
+    written = sensors.writeHistory(page, clockOffset, addr, since, 20);
+    CHECK(written <= 20);
+    CHECK_EQ(page.lines(), written + 1);
+    count += written;
+    if (written == 0) break;
+
+    // drop the header, and pick up after the last time on the page
+    pages.text += page.text.substr(page.text.find('\n') + 1);
+    size_t lastLine = page.text.rfind('\n', page.text.size() - 2) + 1;
+    since = strtoul(page.text.c_str() + page.text.find(',', lastLine) + 1, NULL, 10);
+  } while (written == 20);
+
+  CHECK_EQ(count, all.lines() - 1);
+  CHECK(pages.text == all.text.substr(all.text.find('\n') + 1));
+}
+
+int main() {
+  testRoundTrip();
+  testRuns();
+  testHistoryPages();
+  return checkResult();
+}
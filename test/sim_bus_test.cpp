@@ -0,0 +1,117 @@
+// The simulated bus against the parts of the protocol the driver relies
+// on: search with discrepancies, conversion latency and the ready bit,
+// Read Power Supply and the injected faults.
+#include "OneWireSim.h"
+#include "check.h"
+
+static OneWireSim bus;
+
+static bool readScratchpad(const uint8_t rom[8], uint8_t data[9]) {
+  if (!bus.reset()) return false;
+  bus.select(rom);
+  bus.write(0xBE);
+  bus.read_bytes(data, 9);
+  return OneWire::crc8(data, 8) == data[8];
+}
+
+static void testSearch() {
+  uint8_t addr[8];
+  int found = 0;
+  bool seen[ONEWIRE_SIM_MAX_DEVICES] = {false};
+
+  // serial numbers that share long prefixes force plenty of discrepancies
+  for (int i = 0; i < ONEWIRE_SIM_MAX_DEVICES; i++) {
+    CHECK_EQ(bus.addDevice(i % 3 ? SIM_DS18B20 : SIM_DS18S20, i * 0x01010101UL, 20.0), i);
+  }
+  CHECK_EQ(bus.addDevice(SIM_DS18B20, 0xFFFF, 20.0), -1);
+
+  bus.reset_search();
+  while (bus.search(addr)) {
+    CHECK_EQ(OneWire::crc8(addr, 7), addr[7]);
+    for (int i = 0; i < bus.count(); i++) {
+      if (memcmp(addr, bus.device(i).rom, 8) == 0) {
+        CHECK(!seen[i]);
+        seen[i] = true;
+      }
+    }
+    found++;
+  }
+  CHECK_EQ(found, ONEWIRE_SIM_MAX_DEVICES);
+  CHECK(bus.search_discrepancies >= ONEWIRE_SIM_MAX_DEVICES - 1);
+}
+
+static void testConversion() {
+  const uint8_t *rom = bus.device(1).rom;
+  uint8_t data[9];
+  unsigned long started;
+
+  bus.setTemperature(1, 23.5);
+  bus.reset();
+  bus.select(rom);
+  bus.write(0x44);
+
+  // an externally powered DS18B20 holds read slots low for 750ms at 12 bits
+  started = millis();
+  while (!bus.read_bit()) delay(1);
+  CHECK(millis() - started >= 749 && millis() - started <= 751);
+
+  CHECK(readScratchpad(rom, data));
+  CHECK_EQ(static_cast<int16_t>(data[0] | data[1] << 8), 23.5 * 16);
+}
+
+static void testParasite() {
+  static OneWireSim single;
+  uint8_t data[9];
+
+  single.addDevice(SIM_DS18B20, 0x123456, 30.0, true);
+  const uint8_t *rom = single.device(0).rom;
+
+  single.reset();
+  single.select(rom);
+  single.write(0xB4); // Read Power Supply
+  CHECK_EQ(single.read_bit(), 0);
+
+  // without the strong pullup the conversion browns out
+  single.reset();
+  single.skip();
+  single.write(0x44);
+  delay(800);
+  single.reset();
+  single.select(rom);
+  single.write(0xBE);
+  single.read_bytes(data, 9);
+  CHECK_EQ(data[0] | data[1] << 8, 0x0550); // still the 85C power on value
+
+  single.reset();
+  single.skip();
+  single.write(0x44, 1);
+  delay(800);
+  single.reset();
+  single.select(rom);
+  single.write(0xBE);
+  single.read_bytes(data, 9);
+  CHECK_EQ(data[0] | data[1] << 8, 30 * 16);
+}
+
+static void testFaults() {
+  const uint8_t *rom = bus.device(2).rom;
+  uint8_t data[9];
+
+  bus.corruptNextReads(2, 1);
+  CHECK(!readScratchpad(rom, data));
+  CHECK(readScratchpad(rom, data));
+
+  bus.setPresent(2, false);
+  CHECK(readScratchpad(rom, data) == false);
+  CHECK(!bus.verify(rom));
+  bus.setPresent(2, true);
+  CHECK(bus.verify(rom));
+}
+
+int main() {
+  testSearch();
+  testConversion();
+  testParasite();
+  testFaults();
+  return checkResult();
+}
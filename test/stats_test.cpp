@@ -0,0 +1,100 @@
+// Stats, a sample at a time, merged and through the lane kernel, against a
+// two pass reference in double precision.
+#include "AverageTemps.h"
+#include "check.h"
+#include <math.h>
+
+static uint32_t seed = 1;
+
+static uint32_t nextRandom() {
+  seed ^= seed << 13;
+  seed ^= seed >> 17;
+  seed ^= seed << 5;
+  return seed;
+}
+
+static RawTemp randomReading() {
+  if (nextRandom() % 5 == 0) return RAW_TEMP_INVALID;
+  return static_cast<RawTemp>(nextRandom() % (RAW_TEMP_MAX - RAW_TEMP_MIN + 1)) + RAW_TEMP_MIN;
+}
+
+static bool sameStats(const Stats &a, const Stats &b) {
+  return a.count == b.count && a.sum == b.sum && a.sumSquares == b.sumSquares &&
+    a.minimum() == b.minimum() && a.maximum() == b.maximum();
+}
+
+// Every length up to a few lanes past the tail, then some longer ones
+static void testMatchesReference() {
+  static RawTemp data[10000];
+  static const size_t lengths[] = { 100, 1000, 10000 };
+  int mismatches = 0;
+
+  for (size_t n = 0; n < 40 + 3; n++) {
+    size_t length = n < 40 ? n : lengths[n - 40];
+    Stats added;
+    Stats split, tail;
+    double sum = 0, squares = 0;
+    int count = 0;
+    RawTemp min = INT16_MAX, max = INT16_MIN;
+
+    for (size_t i = 0; i < length; i++) {
+      data[i] = randomReading();
+      added.add(data[i]);
+      if (data[i] == RAW_TEMP_INVALID) continue;
+      sum += data[i];
+      count++;
+      if (data[i] < min) min = data[i];
+      if (data[i] > max) max = data[i];
+    }
+
+    Stats stats = statsOf(data, length);
+    if (!sameStats(stats, added)) mismatches++;
+
+    // merging the two halves gives the same as the whole
+    split = statsOf(data, length / 2);
+    tail = statsOf(data + length / 2, length - length / 2);
+    split.merge(tail);
+    if (!sameStats(stats, split)) mismatches++;
+
+    if (stats.count != count) mismatches++;
+    if (count == 0) {
+      if (stats.mean() != RAW_TEMP_INVALID || stats.minimum() != RAW_TEMP_INVALID ||
+          stats.maximum() != RAW_TEMP_INVALID || stats.stddev16() != 0) mismatches++;
+      continue;
+    }
+    if (stats.mean() != lround(sum / count)) mismatches++;
+    if (stats.minimum() != min || stats.maximum() != max) mismatches++;
+
+    for (size_t i = 0; i < length; i++) {
+      if (data[i] != RAW_TEMP_INVALID) squares += (data[i] - sum / count) * (data[i] - sum / count);
+    }
+    if (count > 1) {
+      double expected = sqrt(squares / (count - 1)) * 16;
+      if (fabs(stats.stddev16() - expected) > 1) mismatches++;
+    }
+  }
+  CHECK_EQ(mismatches, 0);
+}
+
+static void testKnownValues() {
+  const RawTemp data[] = { 320, RAW_TEMP_INVALID, 336, 352, -16 };
+  Stats stats = statsOf(data, 5);
+
+  CHECK_EQ(stats.count, 4);
+  CHECK_EQ(stats.mean(), 248);
+  CHECK_EQ(stats.minimum(), -16);
+  CHECK_EQ(stats.maximum(), 352);
+  // sample standard deviation of 20, 21, 22 and -1 C, in 1/256 C
+  CHECK_EQ(stats.stddev16(), 2823);
+
+  CHECK_EQ(isqrt64(0), 0);
+  CHECK_EQ(isqrt64(99), 9);
+  CHECK_EQ(isqrt64(100), 10);
+  CHECK_EQ(isqrt64(0xFFFFFFFFFFFFFFFFULL), 0xFFFFFFFFUL);
+}
+
+int main() {
+  testMatchesReference();
+  testKnownValues();
+  return checkResult();
+}
@@ -0,0 +1,138 @@
+// OneWireUart against simulated devices on the far side of a looped back
+// UART: the frame each bit is sent as, presence and read slots decoded
+// from the echo, a whole search and scratchpad read, and a bus with no
+// echo at all giving up instead of hanging.
+#include "OneWireUart.h"
+#include "OneWireSim.h"
+#include "check.h"
+
+// The echo a device holding a read slot low leaves: at 115200 baud the
+// start bit and the first data bits are about 9us each, and a 0 is held
+// for 15us or more, into bit 1 at least
+#define READ_ZERO_ECHO 0xF8
+// A presence pulse starts 15-60us after the reset low ends, while the
+// 9600 baud frame's high bits (about 104us each) are still going out
+#define PRESENCE_ECHO 0xE0
+
+// Turns each frame into the slot it stands for on a simulated bus
+class SimUart : public USARTSerial {
+  public:
+    OneWireSim &sim;
+    int frames = 0;
+    int resets = 0;
+
+    SimUart(OneWireSim &sim): sim(sim) {}
+
+    int line(uint8_t frame, unsigned long baud) {
+      frames++;
+      if (baud == 9600) {
+        resets++;
+        CHECK_EQ(frame, 0xF0);
+        return sim.reset() ? PRESENCE_ECHO : frame;
+      }
+      CHECK_EQ(baud, 115200);
+      if (frame == 0x00) {
+        sim.write_bit(0);
+        return frame;
+      }
+      // a write 1 slot is a read slot too, the master's 1 is the pullup's
+      CHECK_EQ(frame, 0xFF);
+      return sim.read_bit() ? frame : READ_ZERO_ECHO;
+    }
+};
+
+// A UART whose RX isn't connected
+class DeadUart : public USARTSerial {
+  public:
+    int line(uint8_t, unsigned long) { return -1; }
+};
+
+static OneWireSim sim;
+static SimUart uart(sim);
+static OneWireUart bus(uart);
+
+// One frame a bit, least significant first: 0xFF is a short low, a 1 or
+// a read slot, and 0x00 a long one, a 0. Anything but an unchanged 0xFF
+// coming back is a device pulling the line, a 0.
+static void testEncoding() {
+  uint8_t frames[8];
+
+  OneWireUart::encode(0xA5, frames);
+  static const uint8_t expected[8] = { 0xFF, 0x00, 0xFF, 0x00, 0x00, 0xFF, 0x00, 0xFF };
+  CHECK(memcmp(frames, expected, 8) == 0);
+
+  for (int v = 0; v < 256; v++) {
+    OneWireUart::encode(v, frames);
+    CHECK_EQ(OneWireUart::decode(frames), v);
+  }
+
+  OneWireUart::encode(0xFF, frames);
+  frames[3] = READ_ZERO_ECHO;
+  frames[6] = 0xFE;
+  CHECK_EQ(OneWireUart::decode(frames), 0xB7);
+}
+
+// The reset goes out at 9600 baud, with the UART back at 115200 for the
+// slots after it, and only a presence pulse changes its echo
+static void testPresence() {
+  bus.begin();
+  CHECK_EQ(bus.reset(), 1);
+  CHECK_EQ(uart.resets, 1);
+  CHECK_EQ(uart.baudRate(), 115200UL);
+
+  sim.setPresent(0, false);
+  sim.setPresent(1, false);
+  CHECK_EQ(bus.reset(), 0);
+  sim.setPresent(0, true);
+  sim.setPresent(1, true);
+}
+
+// Search and a scratchpad read through the echo decoding come out the
+// same as the devices' own ROMs and scratchpads
+static void testSearchAndRead() {
+  uint8_t addr[8];
+  uint8_t data[9];
+  int found = 0;
+
+  bus.reset_search();
+  while (bus.search(addr)) {
+    CHECK_EQ(OneWire::crc8(addr, 7), addr[7]);
+    CHECK(memcmp(addr, sim.device(0).rom, 8) == 0 || memcmp(addr, sim.device(1).rom, 8) == 0);
+    found++;
+  }
+  CHECK_EQ(found, 2);
+
+  uart.frames = 0;
+  CHECK(bus.reset());
+  bus.select(sim.device(1).rom);
+  bus.write(0xBE);
+  bus.read_bytes(data, 9);
+  CHECK(memcmp(data, sim.device(1).scratchpad, 9) == 0);
+  // the reset, then a frame a bit: 10 bytes out and 9 back
+  CHECK_EQ(uart.frames, 1 + 8 * (10 + 9));
+}
+
+// With nothing echoing, each transfer times out: no presence, and read
+// slots come back as the ones an idle bus would give
+static void testNoEcho() {
+  static DeadUart dead;
+  OneWireUart deadBus(dead);
+  unsigned long started = micros();
+
+  deadBus.begin();
+  CHECK_EQ(deadBus.reset(), 0);
+  CHECK_EQ(deadBus.read_bit(), 1);
+  CHECK_EQ(deadBus.read(), 0xFF);
+  CHECK(micros() - started >= 3 * ONEWIRE_UART_TIMEOUT_US);
+}
+
+int main() {
+  sim.addDevice(SIM_DS18B20, 1, 20.0);
+  sim.addDevice(SIM_DS18S20, 2, 21.0);
+
+  testEncoding();
+  testPresence();
+  testSearchAndRead();
+  testNoEcho();
+  return checkResult();
+}